@@ -0,0 +1,99 @@
+/** 
+ * \file    bf_alias.c
+ * \brief   Valgrind Tool: BITFLIPS alias-method discrete sampling
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+#include "pub_tool_basics.h"
+#include "pub_tool_libcassert.h"
+#include "pub_tool_mallocfree.h"
+
+#include "bf_alias.h"
+#include "bf_random.h"
+
+
+void
+BF_(Alias_init) (  VgBF_Alias_t* table
+                 , const UInt*   values
+                 , const double* weights
+                 , UInt          n )
+{
+  UInt    i, s, l;
+  UInt    num_small = 0;
+  UInt    num_large = 0;
+  UInt*   small     = VG_(malloc)("bf.alias", n * sizeof(UInt));
+  UInt*   large     = VG_(malloc)("bf.alias", n * sizeof(UInt));
+  double* scaled    = VG_(malloc)("bf.alias", n * sizeof(double));
+  double  sum       = 0.0;
+
+
+  tl_assert(n > 0);
+
+  for (i = 0; i < n; ++i)
+  {
+    tl_assert(weights[i] >= 0);
+    sum += weights[i];
+  }
+
+  tl_assert(sum > 0);
+
+  table->size   = n;
+  table->values = VG_(malloc)("bf.alias", n * sizeof(UInt));
+  table->alias  = VG_(malloc)("bf.alias", n * sizeof(UInt));
+  table->prob   = VG_(malloc)("bf.alias", n * sizeof(double));
+
+  /* Scale so the average weight is one, then split into columns that
+     are under- and over-full */
+  for (i = 0; i < n; ++i)
+  {
+    table->values[i] = values[i];
+    table->alias [i] = i;
+    scaled[i]        = weights[i] * n / sum;
+
+    if (scaled[i] < 1.0) small[num_small++] = i;
+    else                 large[num_large++] = i;
+  }
+
+  /* Top up each under-full column from an over-full one */
+  while (num_small > 0 && num_large > 0)
+  {
+    s = small[--num_small];
+    l = large[--num_large];
+
+    table->prob [s] = scaled[s];
+    table->alias[s] = l;
+
+    scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+
+    if (scaled[l] < 1.0) small[num_small++] = l;
+    else                 large[num_large++] = l;
+  }
+
+  /* Whatever remains is full up to rounding error */
+  while (num_large > 0) table->prob[large[--num_large]] = 1.0;
+  while (num_small > 0) table->prob[small[--num_small]] = 1.0;
+
+  VG_(free)(small);
+  VG_(free)(large);
+  VG_(free)(scaled);
+}
+
+
+UInt
+BF_(Alias_draw) (const VgBF_Alias_t* table)
+{
+  UInt column = BF_(Random_below32)(table->size);
+
+
+  if (BF_(Random_uniform)() < table->prob[column])
+  {
+    return table->values[column];
+  }
+  else
+  {
+    return table->values[ table->alias[column] ];
+  }
+}
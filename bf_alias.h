@@ -0,0 +1,48 @@
+/** 
+ * \file    bf_alias.h
+ * \brief   Valgrind Tool: BITFLIPS alias-method discrete sampling
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+
+#ifndef __BITFLIPS_ALIAS_H
+#define __BITFLIPS_ALIAS_H
+
+
+#include "bf_include.h"
+
+
+/**
+ * An alias table (Walker 1977, Vose 1991) draws one of n values with
+ * arbitrary probabilities in O(1): pick a column uniformly, then keep it
+ * with probability prob[column] or take its alias otherwise.
+ */
+typedef struct
+{
+  UInt     size;
+  UInt*    values;
+  UInt*    alias;
+  double*  prob;
+} VgBF_Alias_t;
+
+
+/**
+ * Builds an alias table drawing values[i] with probability proportional
+ * to weights[i], i < n.  Weights must be non-negative with a positive
+ * sum.
+ */
+void BF_(Alias_init) (  VgBF_Alias_t* table
+                      , const UInt*   values
+                      , const double* weights
+                      , UInt          n );
+
+/**
+ * @return a value drawn from table.
+ */
+UInt BF_(Alias_draw) (const VgBF_Alias_t* table);
+
+
+#endif  /* __BITFLIPS_ALIAS_H */
@@ -0,0 +1,146 @@
+/** 
+ * \file    bf_exposure.c
+ * \brief   Valgrind Tool: BITFLIPS cumulative exposure table
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+#include "pub_tool_basics.h"
+#include "pub_tool_libcassert.h"
+#include "pub_tool_libcbase.h"
+#include "pub_tool_mallocfree.h"
+
+#include "bf_exposure.h"
+
+
+/**
+ * Adds delta (modulo 2^64, so subtraction works too) to the weight of
+ * slot in the Fenwick tree.
+ */
+static void
+BF_(Exposure_adjust) (VgBF_Exposure_t* e, UInt slot, ULong delta)
+{
+  UInt i;
+
+
+  for (i = slot + 1; i <= e->capacity; i += i & (~i + 1))
+  {
+    e->tree[i] += delta;
+  }
+}
+
+
+/**
+ * Doubles the number of slots and rebuilds the Fenwick tree in O(n).
+ */
+static void
+BF_(Exposure_grow) (VgBF_Exposure_t* e)
+{
+  UInt i, parent;
+  UInt capacity = (e->capacity == 0) ? 64 : 2 * e->capacity;
+
+
+  e->tree   = VG_(realloc)("bf.exposure", e->tree,
+                           (capacity + 1) * sizeof(ULong));
+  e->weight = VG_(realloc)("bf.exposure", e->weight,
+                           capacity * sizeof(ULong));
+  e->items  = VG_(realloc)("bf.exposure", e->items,
+                           capacity * sizeof(void*));
+  e->free   = VG_(realloc)("bf.exposure", e->free,
+                           capacity * sizeof(UInt));
+
+  VG_(memset)(e->tree, 0, (capacity + 1) * sizeof(ULong));
+
+  for (i = 1; i <= capacity; ++i)
+  {
+    if (i <= e->used) e->tree[i] += e->weight[i - 1];
+
+    parent = i + (i & (~i + 1));
+    if (parent <= capacity) e->tree[parent] += e->tree[i];
+  }
+
+  e->capacity = capacity;
+}
+
+
+void
+BF_(Exposure_init) (VgBF_Exposure_t* e)
+{
+  VG_(memset)(e, 0, sizeof(VgBF_Exposure_t));
+}
+
+
+UInt
+BF_(Exposure_add) (VgBF_Exposure_t* e, void* item, ULong weight)
+{
+  UInt slot;
+
+
+  if (e->num_free > 0)
+  {
+    slot = e->free[--e->num_free];
+  }
+  else
+  {
+    if (e->used == e->capacity) BF_(Exposure_grow)(e);
+    slot = e->used++;
+  }
+
+  e->items [slot]  = item;
+  e->weight[slot]  = weight;
+  e->total        += weight;
+  BF_(Exposure_adjust)(e, slot, weight);
+
+  return slot;
+}
+
+
+void
+BF_(Exposure_remove) (VgBF_Exposure_t* e, UInt slot)
+{
+  tl_assert(slot < e->used);
+
+  BF_(Exposure_adjust)(e, slot, -e->weight[slot]);
+  e->total        -= e->weight[slot];
+  e->weight[slot]  = 0;
+  e->items [slot]  = 0;
+  e->free[e->num_free++] = slot;
+}
+
+
+void
+BF_(Exposure_resize) (VgBF_Exposure_t* e, UInt slot, ULong weight)
+{
+  tl_assert(slot < e->used);
+
+  BF_(Exposure_adjust)(e, slot, weight - e->weight[slot]);
+  e->total        += weight - e->weight[slot];
+  e->weight[slot]  = weight;
+}
+
+
+void*
+BF_(Exposure_find) (const VgBF_Exposure_t* e, ULong offset, ULong* within)
+{
+  UInt pos  = 0;
+  UInt step = e->capacity;
+
+
+  if (offset >= e->total) return 0;
+
+  /* Find the last position whose cumulative weight is <= offset */
+  for (; step > 0; step >>= 1)
+  {
+    if (pos + step <= e->capacity && e->tree[pos + step] <= offset)
+    {
+      pos    += step;
+      offset -= e->tree[pos];
+    }
+  }
+
+  if (within != 0) *within = offset;
+
+  return e->items[pos];
+}
@@ -0,0 +1,71 @@
+/** 
+ * \file    bf_exposure.h
+ * \brief   Valgrind Tool: BITFLIPS cumulative exposure table
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+
+#ifndef __BITFLIPS_EXPOSURE_H
+#define __BITFLIPS_EXPOSURE_H
+
+
+#include "bf_include.h"
+
+
+/**
+ * An exposure table holds a set of items (e.g. MemBlocks), each with an
+ * integer weight (e.g. its size in bytes).  It keeps the total weight
+ * and a cumulative-weight (Fenwick) tree, so items can be added or
+ * removed in O(log n) and an item can be chosen with probability
+ * proportional to its weight by a single O(log n) descent.
+ *
+ * Every item occupies a slot, returned by BF_(Exposure_add) and stable
+ * until BF_(Exposure_remove) releases it for reuse.
+ */
+typedef struct
+{
+  UInt    capacity;     /* Number of slots allocated (a power of two) */
+  UInt    used;         /* High-water mark of slots handed out        */
+  UInt    num_free;     /* Number of released slots in free           */
+  ULong   total;        /* Sum of all weights                         */
+  ULong*  tree;         /* Fenwick tree, 1-based, capacity + 1 long   */
+  ULong*  weight;       /* Weight of each slot                        */
+  void**  items;        /* Item stored in each slot                   */
+  UInt*   free;         /* Stack of released slots                    */
+} VgBF_Exposure_t;
+
+
+/**
+ * Initializes an empty exposure table.
+ */
+void  BF_(Exposure_init)   (VgBF_Exposure_t* e);
+
+/**
+ * Adds item with the given weight and returns its slot.
+ */
+UInt  BF_(Exposure_add)    (VgBF_Exposure_t* e, void* item, ULong weight);
+
+/**
+ * Removes the item in slot.
+ */
+void  BF_(Exposure_remove) (VgBF_Exposure_t* e, UInt slot);
+
+/**
+ * Changes the weight of the item in slot.
+ */
+void  BF_(Exposure_resize) (VgBF_Exposure_t* e, UInt slot, ULong weight);
+
+/**
+ * @return the item covering position offset in [0, e->total) when all
+ * items are laid end to end in slot order, storing the position relative
+ * to the start of that item in *within (if non-null).  Returns null if
+ * offset >= e->total.
+ */
+void* BF_(Exposure_find)   (const VgBF_Exposure_t* e, ULong offset,
+                            ULong* within);
+
+
+#endif  /* __BITFLIPS_EXPOSURE_H */
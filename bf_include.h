@@ -0,0 +1,62 @@
+/** 
+ * \file    bf_include.h
+ * \brief   Valgrind Tool: BITFLIPS declarations shared between modules
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+
+#ifndef __BITFLIPS_INCLUDE_H
+#define __BITFLIPS_INCLUDE_H
+
+
+#include "pub_tool_basics.h"
+#include "pub_tool_execontext.h"
+
+#include "bitflips.h"
+
+
+#define BF_(str)    VGAPPEND(vgBitFlips_,str)
+
+
+/**
+ * How a MemBlock was registered: by a VALGRIND_BITFLIPS_MEM_ON client
+ * request, or automatically for a heap allocation (--expose-heap), a
+ * global variable (--expose-globals) or a thread's stack
+ * (--expose-stack).  BF_ORIGIN_REGISTER marks the pseudo-blocks that
+ * describe guest register groups (--register-fault-rate), which are
+ * never registered.
+ */
+typedef enum
+{
+    BF_ORIGIN_USER
+  , BF_ORIGIN_HEAP
+  , BF_ORIGIN_GLOBAL
+  , BF_ORIGIN_STACK
+  , BF_ORIGIN_REGISTER
+} VgBF_Origin_t;
+
+
+typedef struct _VgBF_MemBlock_t
+{
+  Addr              start;
+  Addr              end;
+  SizeT             num_bytes;
+  SizeT             num_rows;
+  SizeT             num_cols;
+  SizeT             num_elems;
+  double            num_kilobytes;
+  const HChar*      desc;
+  VgBF_MemType_t    type;
+  VgBF_MemOrder_t   layout;
+  VgBF_Origin_t     origin;
+  ExeContext*       where;
+  UInt              slot;
+  UInt              id;
+  Bool              traced;
+} VgBF_MemBlock_t;
+
+
+#endif  /* __BITFLIPS_INCLUDE_H */
@@ -20,88 +20,308 @@
 #include "pub_tool_libcproc.h"
 #include "pub_tool_machine.h"
 #include "pub_tool_mallocfree.h"
+#include "pub_tool_oset.h"
+#include "pub_tool_deduppoolalloc.h"
+#include "pub_tool_libcfile.h"
+#include "pub_tool_vki.h"
+#include "pub_tool_transtab.h"
+#include "pub_tool_debuginfo.h"
+#include "pub_tool_replacemalloc.h"
+#include "pub_tool_threadstate.h"
+#include "pub_tool_xarray.h"
 
 #include "VEX/pub/libvex_guest_x86.h"
 
-#include "bitflips.h"
+#if defined(VGA_amd64)
+#  include "VEX/pub/libvex_guest_amd64.h"
+#elif defined(VGA_arm64)
+#  include "VEX/pub/libvex_guest_arm64.h"
+#endif
+
+#include "bf_include.h"
+#include "bf_alias.h"
+#include "bf_exposure.h"
+#include "bf_math.h"
 #include "bf_poisson.h"
+#include "bf_random.h"
+#include "bf_trace.h"
+#include "bf_value.h"
+
+
+#if defined(VG_BIGENDIAN)
+#  define BF_END Iend_BE
+#elif defined(VG_LITTLEENDIAN)
+#  define BF_END Iend_LE
+#else
+#  error "Unknown endianness"
+#endif
+
+
+/**
+ * The default probability distribution of how many bits a single SEU
+ * flips, as "<bits>:<weight>" pairs (see --flip-density).
+ */
+#define BF_DEFAULT_FLIP_DENSITY "1:60,2:30,3:5,4:2,5:1,6:1,7:1"
+
+#define BF_MAX_FLIP_BITS 64
+
+/**
+ * Limits of the multi-cell upset model (see BF_(doBurst)): the longest
+ * cluster in bits, the largest interleaving factor and the number of
+ * consecutive elements one cluster may reach.
+ */
+#define BF_MAX_MCU_BITS       256
+#define BF_MAX_MCU_INTERLEAVE 64
+#define BF_MAX_MCU_SPAN       256
+
+/**
+ * The default number of instructions per second used to convert a
+ * per-second --fault-rate (see --insn-rate).
+ */
+#define BF_DEFAULT_INSN_RATE "1G"
+
+
+/**
+ * How the arrival of SEUs is simulated.  BF_SCHEDULE_POISSON draws a
+ * Poisson number of faults for every block before every instruction.
+ * BF_SCHEDULE_SKIP draws the gap to the next faulty instruction from the
+ * combined rate of all exposed blocks and counts down to it.  Both
+ * produce the same fault statistics.
+ */
+typedef enum
+{
+    BF_SCHEDULE_POISSON
+  , BF_SCHEDULE_SKIP
+} VgBF_Schedule_t;
+
+
+/**
+ * How the fault check is instrumented before every instruction.
+ * BF_CHECK_HELPER calls a C helper unconditionally.  BF_CHECK_INLINE
+ * updates the counters in IR and calls the helper only when the
+ * BF_SCHEDULE_SKIP countdown reaches zero.  BF_CHECK_SUPERBLOCK calls a
+ * helper once per superblock exit with the number of instructions
+ * executed since the previous call.
+ */
+typedef enum
+{
+    BF_CHECK_HELPER
+  , BF_CHECK_INLINE
+  , BF_CHECK_SUPERBLOCK
+} VgBF_Check_t;
 
 
-#define BF_(str)    VGAPPEND(vgBitFlips_,str)
+/**
+ * What counts as one "instruction" in the FaultRate units.
+ * BF_UNIT_STMT counts every VEX IR statement, so the effective rate
+ * depends on how the guest code was lowered to IR.  BF_UNIT_INSN counts
+ * guest machine instructions (Ist_IMark statements).
+ */
+typedef enum
+{
+    BF_UNIT_STMT
+  , BF_UNIT_INSN
+} VgBF_Unit_t;
+
+
+/**
+ * When a scheduled SEU changes memory.  BF_INJECT_EAGER flips the bits
+ * immediately.  BF_INJECT_LAZY records the flip as pending against the
+ * element and applies it only when a guest load touches the element;
+ * a store that overwrites all of its flipped bits first masks it.
+ */
+typedef enum
+{
+    BF_INJECT_EAGER
+  , BF_INJECT_LAZY
+} VgBF_InjectMode_t;
+
 
-// Assumes the VG_(random) implementation returns UInt (unsigned 32-bit int)
-#define VG_RAND_MAX 0xffffffff
+/**
+ * An SEU pending under BF_INJECT_LAZY: mask is the XOR of the events
+ * scheduled against the element at addr that have not yet been read
+ * or overwritten.
+ */
+typedef struct
+{
+  Addr              addr;
+  UInt              size;
+  UInt              events;
+  ULong             mask;
+  VgBF_MemBlock_t*  block;
+} VgBF_Pending_t;
 
 
-typedef struct _VgBF_MemBlock_t
+/**
+ * A heap or global block released in favour of an overlapping
+ * VALGRIND_BITFLIPS_MEM_ON region.  It is registered again once no
+ * client request overlaps it, unless it is freed or unmapped first.
+ */
+typedef struct
 {
   Addr              start;
   Addr              end;
-  SizeT             num_bytes;
-  SizeT             num_rows;
-  SizeT             num_cols;
-  SizeT             num_elems;
-  double            num_kilobytes;
-  HChar*            desc;
-  VgBF_MemType_t    type;
-  VgBF_MemOrder_t   layout;
-  ExeContext*       where;
+  const HChar*      desc;
+  VgBF_Origin_t     origin;
+} VgBF_Shadowed_t;
+
 
-  struct _VgBF_MemBlock_t* next;
+/**
+ * How instructions outside the code selected by --inject-in-fn,
+ * --inject-in-obj and --exclude-obj are accounted.  BF_OUTSIDE_STOP
+ * leaves them uninstrumented, so the fault clock stops while they run.
+ * BF_OUTSIDE_BULK advances the clock once per superblock exit, as
+ * BF_CHECK_SUPERBLOCK does.
+ */
+typedef enum
+{
+    BF_OUTSIDE_STOP
+  , BF_OUTSIDE_BULK
+} VgBF_Outside_t;
 
-} VgBF_MemBlock_t;
 
+/**
+ * A list of glob patterns given by repeating an option.
+ */
+#define BF_MAX_PATTERNS 32
 
 typedef struct
-{ 
-  UInt  bits;
-  UInt  lo;
-  UInt  hi;
-}
-VgBF_Distribution_t;
+{
+  UInt          n;
+  const HChar*  pattern[BF_MAX_PATTERNS];
+} VgBF_Patterns_t;
 
 
 /**
- * The following probability distribution indicates how often a certain
- * number of bits will be flipped.
+ * A group of count consecutive guest registers of size bytes each,
+ * at offset in the guest state, exposed by --register-fault-rate.
+ * Registers are flipped in lanes of the element type (the integer or
+ * FP word size), so an SEU never spans two lanes.  block describes the
+ * group for reporting: row is the register number and col the lane.
  */
-VgBF_Distribution_t BitFlipDensity[] =
+typedef struct
 {
-    {.bits = 1, .lo =  0, .hi = 60}
-  , {.bits = 2, .lo = 61, .hi = 90}
-  , {.bits = 3, .lo = 91, .hi = 95}
-  , {.bits = 4, .lo = 96, .hi = 97}
-  , {.bits = 5, .lo = 97, .hi = 97}
-  , {.bits = 6, .lo = 98, .hi = 98}
-  , {.bits = 7, .lo = 99, .hi = 99}
-};
+  const HChar*      name;
+  Int               offset;
+  UInt              count;
+  UInt              size;
+  VgBF_MemType_t    type;
+  VgBF_MemBlock_t   block;
+} VgBF_RegGroup_t;
+
+
+/**
+ * Poisson samplers are cached for periods of 1 .. BF_SAMPLER_CACHE - 1
+ * instructions and rebuilt when ExposureGeneration changes.
+ */
+#define BF_SAMPLER_CACHE 256
+
+typedef struct
+{
+  ULong                   generation;
+  random_poisson_sampler  sampler;
+} VgBF_Sampler_t;
 
 /*                                1111111111222222222233 */       
 /*                       1234567890123456789012345678901 */
 static UInt              FaultCount       = 0;
-static float             FaultRate        = 0;
+static double            FaultRate        = 0;
+static const HChar*      FaultRateSpec    = "0";
+static const HChar*      InsnRateSpec     = BF_DEFAULT_INSN_RATE;
 static Bool              FaultInjection   = True;
 static ULong             InstructionCount = 0;
 static double            KilobyteFlux     = 0.0;
-static UInt              RandomState      = 42;
+static UInt              RandomSeed       = 42;
+static VgBF_RngKind_t    RngKind          = BF_RNG_LCG;
+static const HChar*      FlipDensitySpec  = BF_DEFAULT_FLIP_DENSITY;
+static const HChar*      FlipDensityFile  = 0;
+static VgBF_Alias_t      FlipDensity;
+static const HChar*      McuDensitySpec   = 0;
+static VgBF_Alias_t      McuDensity;
+static UInt              McuInterleave    = 1;
+static ULong             McuEvents        = 0;
+static ULong             McuMasks[BF_MAX_MCU_SPAN];
 static Bool              Verbose          = False;
-static VgBF_MemBlock_t*  MemBlockHead     = 0;
+static OSet*             MemBlocks        = 0;
+static OSet*             Shadowed         = 0;
+static DedupPoolAlloc*   Descs            = 0;
+static UInt              NextBlockId      = 0;
+static const HChar*      TraceFile        = 0;
+static VgBF_Exposure_t   Exposure;
+static Bool              SkipIdle         = False;
+static VgBF_Patterns_t   InjectFns;
+static VgBF_Patterns_t   InjectObjs;
+static VgBF_Patterns_t   ExcludeObjs;
+static VgBF_Outside_t    OutsideTime      = BF_OUTSIDE_STOP;
+static Bool              Idle             = False;
+static Bool              ExposeHeap       = False;
+static ULong             HeapBlocks       = 0;
+static VgBF_Patterns_t   ExposeGlobals;
+static ULong             GlobalBlocks     = 0;
+static Bool              ExposeStack      = False;
+static Addr*             Stacks           = 0;
+static VgBF_InjectMode_t InjectMode       = BF_INJECT_EAGER;
+static OSet*             Pending          = 0;
+static ULong             PendingCount     = 0;
+static ULong             LazyScheduled    = 0;
+static ULong             LazyActivated    = 0;
+static ULong             LazyMasked       = 0;
+static ULong             LazyLatent       = 0;
+static UInt              ForkRuns         = 0;
+static UInt              ForkJobs         = 1;
+static Bool              Forked           = False;
+static ULong             FloatFaultCount  = 0;
+static ULong             NonFiniteCount   = 0;
+static double            MaxRelError      = 0.0;
+
+static VgBF_Schedule_t   FaultSchedule    = BF_SCHEDULE_POISSON;
+static VgBF_Check_t      FaultCheck       = BF_CHECK_HELPER;
+static VgBF_Unit_t       RateUnit         = BF_UNIT_STMT;
+static ULong             FaultCountdown   = ~0ULL;
+static ULong             ScheduleStart    = 0;
+static double            ExposedKilobytes = 0.0;
+static ULong             ExposureGeneration = 1;
+static VgBF_Sampler_t    Samplers[BF_SAMPLER_CACHE];
+static const HChar*      RegisterFaultRateSpec = "0";
+static double            RegisterFaultRate     = 0.0;
+static ULong             RegisterBytes         = 0;
+static ULong             RegisterCountdown     = ~0ULL;
+static ULong             RegisterFaultCount    = 0;
+static UWord             FlushedCount          = 0;
+static random_poisson_sampler RegisterSampler;
 
 
 /**
- * @return a uniform random integer number in the range [0 (n - 1)].
+ * The guest registers exposed by --register-fault-rate: the integer,
+ * x87 and vector register files, where supported.
  */
-static UInt
-BF_(randomInt) (UInt* seed, UInt n)
+#if defined(VGA_amd64)
+#  define BF_REG_GROUPS 3
+static VgBF_RegGroup_t   RegGroups[BF_REG_GROUPS] =
 {
-  return VG_(random)(seed) % n;
-}
-
-static double
-BF_(randomUniformDouble) (void)
+    { "gpr"  , offsetof(VexGuestAMD64State, guest_RAX)  , 16,  8, BITFLIPS_ULONG,  { 0 } }
+  , { "fpreg", offsetof(VexGuestAMD64State, guest_FPREG),  8,  8, BITFLIPS_DOUBLE, { 0 } }
+  , { "ymm"  , offsetof(VexGuestAMD64State, guest_YMM0) , 16, 32, BITFLIPS_ULONG,  { 0 } }
+};
+#elif defined(VGA_x86)
+#  define BF_REG_GROUPS 3
+static VgBF_RegGroup_t   RegGroups[BF_REG_GROUPS] =
 {
-  return ((double)VG_(random)(&RandomState)) / ((double)VG_RAND_MAX);
-}
+    { "gpr"  , offsetof(VexGuestX86State, guest_EAX)    ,  8,  4, BITFLIPS_UINT,   { 0 } }
+  , { "fpreg", offsetof(VexGuestX86State, guest_FPREG)  ,  8,  8, BITFLIPS_DOUBLE, { 0 } }
+  , { "xmm"  , offsetof(VexGuestX86State, guest_XMM0)   ,  8, 16, BITFLIPS_UINT,   { 0 } }
+};
+#elif defined(VGA_arm64)
+#  define BF_REG_GROUPS 2
+static VgBF_RegGroup_t   RegGroups[BF_REG_GROUPS] =
+{
+    { "x"    , offsetof(VexGuestARM64State, guest_X0)   , 31,  8, BITFLIPS_ULONG,  { 0 } }
+  , { "q"    , offsetof(VexGuestARM64State, guest_Q0)   , 32, 16, BITFLIPS_ULONG,  { 0 } }
+};
+#else
+#  define BF_REG_GROUPS 0
+static VgBF_RegGroup_t   RegGroups[1];
+#endif
 
 
 /**
@@ -184,471 +404,2737 @@ BF_(MemBlock_getRow) (VgBF_MemBlock_t* block, Addr addr)
 
 
 /**
- * Marks the memory passed via the Valgrind Client Request mechanism
- * as susceptible to SEUs.
+ * Orders an address relative to a MemBlock: zero if the block contains
+ * it.  Since registered blocks never overlap, this is consistent with
+ * the MemBlocks ordering by start address.
  */
-static void
-BF_(MemOn) (ThreadId tid, UWord* arg)
+static Word
+BF_(MemBlock_cmpAddr) (const void* key, const void* elem)
 {
-  UInt             bytes;
-  VgBF_MemBlock_t* block = VG_(malloc)( "bf", sizeof(VgBF_MemBlock_t) );
+  Addr                   addr  = *(const Addr*) key;
+  const VgBF_MemBlock_t* block = elem;
+
 
+  if (addr < block->start) return -1;
+  if (addr > block->end  ) return  1;
+  return 0;
+}
 
-  block->start     = arg[1];
-  block->num_rows  = arg[2];
-  block->num_cols  = arg[3];
-  block->desc      = VG_(strdup)( "bf", (HChar *) arg[4] );
-  block->type      = arg[5] & (BITFLIPS_ROW_MAJOR - 1);
-  block->layout    = arg[5] & (BITFLIPS_ROW_MAJOR + BITFLIPS_COL_MAJOR);
-  block->where     = VG_(record_ExeContext)(tid, 0);
-  block->next      = 0;
 
+/**
+ * Orders an address relative to a shadowed block, as
+ * BF_(MemBlock_cmpAddr) does for a MemBlock.
+ */
+static Word
+BF_(Shadowed_cmpAddr) (const void* key, const void* elem)
+{
+  Addr                   addr  = *(const Addr*) key;
+  const VgBF_Shadowed_t* s     = elem;
 
-  bytes                = BF_(sizeof)(block->type);
-  block->num_elems     = block->num_rows  * block->num_cols;
-  block->num_bytes     = block->num_elems * bytes;
-  block->num_kilobytes = block->num_bytes / 1000.0;
-  block->end           = block->start + block->num_bytes - 1;
 
-  if (MemBlockHead == 0)
-  {
-    MemBlockHead = block;
-  }
-  else
-  {
-    block->next  = MemBlockHead;
-    MemBlockHead = block;
-  }
+  if (addr < s->start) return -1;
+  if (addr > s->end  ) return  1;
+  return 0;
 }
 
 
 /**
- * Marks the memory passed via the Valgrind Client Request mechanism
- * as immune to SEUs.
+ * @return the SEU susceptible MemBlock that contains address or null
+ * (0) if no such block can be found.
  */
-static void
-BF_(MemOff) (UWord* arg)
+static VgBF_MemBlock_t*
+BF_(Addr_getMemBlock) (Addr addr)
 {
-  VgBF_MemBlock_t* block = MemBlockHead;
-  VgBF_MemBlock_t* prev  = 0;
+  return VG_(OSetGen_LookupWithCmp)(MemBlocks, &addr, BF_(MemBlock_cmpAddr));
+}
 
 
-  while (block != 0)
-  {
-    if (block->start == arg[1])
-    {
-      if (prev != 0)
-      {
-        prev->next = block->next;
-      }
-      else
-      {
-        MemBlockHead = block->next;
-      }
+/**
+ * @return a registered MemBlock overlapping [start, end] or null (0) if
+ * there is none.
+ */
+static VgBF_MemBlock_t*
+BF_(MemBlock_findOverlap) (Addr start, Addr end)
+{
+  VgBF_MemBlock_t* block = BF_(Addr_getMemBlock)(start);
 
-      VG_(free)(block->desc);
-      VG_(free)(block);
-      break;
-    }
 
-    prev  = block;
-    block = block->next;
+  if (block == 0)
+  {
+    VG_(OSetGen_ResetIterAt)(MemBlocks, &start);
+    block = VG_(OSetGen_Next)(MemBlocks);
+
+    if (block != 0 && block->start > end) block = 0;
   }
+
+  return block;
 }
 
 
-#if 0
 /**
- * @return the SEU susceptible MemBlock that contains address or null
- * (0) if no such block can be found.
+ * @return the first pending SEU at or after *from whose element
+ * overlaps [addr, addr + size), advancing *from past it, or null (0)
+ * if there is none.  Start with *from at least 7 bytes (the largest
+ * element less one) before addr.
  */
-static VgBF_MemBlock_t*
-BF_(Addr_getMemBlock) (Addr addr)
+static VgBF_Pending_t*
+BF_(nextPending) (Addr* from, Addr addr, SizeT size)
 {
-  VgBF_MemBlock_t* block = MemBlockHead;
+  VgBF_Pending_t* p;
+
 
+  VG_(OSetGen_ResetIterAt)(Pending, from);
 
-  while (block != 0)
+  while ( (p = VG_(OSetGen_Next)(Pending)) != 0 && p->addr < addr + size )
   {
-    /*
-    VG_(printf)(  "addr: %08p, [start: %08p, end: %08p]\n"
-                , addr, block->start, block->end);
-    */
-    if (addr >= block->start && addr <= block->end)
+    if (p->addr + p->size > addr)
     {
-      return block;
+      *from = p->addr + 1;
+      return p;
     }
-
-    block = block->next;
   }
 
   return 0;
 }
-#endif  /* #if 0 */
 
 
 /**
- * @return a bit flip mask width bits wide with flips bits flipped.
+ * Removes the pending SEU p, which must be in Pending.
  */
-static UWord
-BF_(getFlipMask) (UInt width, UInt flips)
+static void
+BF_(removePending) (VgBF_Pending_t* p)
 {
-    if (flips == 1) {
-        // Special case for likely case of only one flip: just shift 1 into a
-        // random position
-        return (1UL << (VG_(random)(&RandomState) % width));
-    }
+  VG_(OSetGen_Remove)(Pending, &p->addr);
+  VG_(OSetGen_FreeNode)(Pending, p);
+  --PendingCount;
+}
 
-    // Otherwise, start with a mask that has `flips` bits set to 1 in the LSB
-    UWord mask = ~((~0UL) << flips);
 
-    // Fischer-Yates Shuffle to shuffle the flipped bits
-    // Bit Swap:
-    // https://www.geeksforgeeks.org/how-to-swap-two-bits-in-a-given-integer/
-    UWord xor;
-    UChar i, swap, bit1, bit2;
-    for (i = width - 1; i > 0; i--) {
-        swap = VG_(random)(&RandomState) % (i + 1);
-        bit1 = (mask >> swap) & 1;
-        bit2 = (mask >> i) & 1;
-        xor = bit1 ^ bit2;
-        mask ^= ((xor << swap) | (xor << i));
-    }
-    return mask;
+/**
+ * Discards the SEUs pending in block, which is being deregistered, as
+ * latent: they were never read.
+ */
+static void
+BF_(dropPending) (VgBF_MemBlock_t* block)
+{
+  VgBF_Pending_t* p;
+  Addr            from = block->start;
+
+
+  if (PendingCount == 0) return;
+
+  while ( (p = BF_(nextPending)(&from, block->start, block->num_bytes)) != 0 )
+  {
+    LazyLatent += p->events;
+    BF_(removePending)(p);
+  }
 }
 
 
 /**
- * @return the number of bits to flip based on the BitFlipDensity.
+ * Marks the memory registered at start, passed via the Valgrind Client
+ * Request mechanism, as immune to SEUs.
  */
-static UInt
-BF_(getFlipSize) (void)
+static void
+BF_(MemOff) (Addr start)
 {
-  UInt n;
-  UInt bits = 0;
-  UInt rand = VG_(random)(&RandomState) % 100;
-  UInt size = sizeof(BitFlipDensity) / sizeof(BitFlipDensity[0]);
+  VgBF_MemBlock_t* block = VG_(OSetGen_Remove)(MemBlocks, &start);
 
 
-  for (n = 0; n < size; ++n)
+  if (block != 0)
   {
-    if (rand >= BitFlipDensity[n].lo && rand <= BitFlipDensity[n].hi)
-    {
-      bits = BitFlipDensity[n].bits;
-      break;
-    }
+    BF_(dropPending)(block);
+    BF_(Exposure_remove)(&Exposure, block->slot);
+    VG_(OSetGen_FreeNode)(MemBlocks, block);
   }
-
- return bits;
 }
 
 
 /**
- * Flips from 1--8 bits (governed by BF_(getFlipSize)() and the
- * BitFlipDensity PDF) at the given address (size bytes wide).  The
- * MemBlock containing addr is passed-in for reporting purposes.
+ * Records the heap or global block, which an overlapping client request
+ * is about to release, in Shadowed.  Stack blocks are not recorded:
+ * BF_(newStack)() registers the stack again as it grows.
  */
 static void
-BF_(doFlipBits) (Addr addr, SizeT size, VgBF_MemBlock_t* block)
+BF_(shadow) (VgBF_MemBlock_t* block)
 {
-  UInt row = BF_(MemBlock_getRow)(block, addr);
-  UInt col = BF_(MemBlock_getCol)(block, addr);
+  VgBF_Shadowed_t* s;
 
-  if (size == 1)
+
+  if (block->origin != BF_ORIGIN_HEAP && block->origin != BF_ORIGIN_GLOBAL)
   {
-    UChar  mask     = BF_(getFlipMask)( 8, BF_(getFlipSize)() );
-    UChar* p        = (UChar*) addr;
-    UChar  original = *p;
-    UChar  flipped  = (original ^ mask);
+    return;
+  }
 
-    *p = flipped;
-    FaultCount++;
+  s         = VG_(OSetGen_AllocNode)(Shadowed, sizeof(VgBF_Shadowed_t));
+  s->start  = block->start;
+  s->end    = block->end;
+  s->desc   = block->desc;
+  s->origin = block->origin;
 
-    if (Verbose)
-    {
-      VG_(message)(Vg_UserMsg, "BF: %s %d %d %d %02x %02x %02x\n",
-                   block->desc, block->type, row, col, original, mask, flipped);
-    }
-  }
-  else if (size == 2)
+  VG_(OSetGen_Insert)(Shadowed, s);
+
+  if (Verbose)
   {
-    UShort  mask     = BF_(getFlipMask)( 16, BF_(getFlipSize)() );
-    UShort* p        = (UShort*) addr;
-    UShort  original = *p;
-    UShort  flipped  = (original ^ mask);
+    VG_(message)(Vg_UserMsg, "shadowed: %s [%#lx, %#lx]\n",
+                 s->desc, s->start, s->end);
+  }
+}
 
-    *p = flipped;
-    FaultCount++;
 
-    if (Verbose)
+/**
+ * Forgets the shadowed blocks of the given origin in [start, end],
+ * which are being freed or unmapped.
+ */
+static void
+BF_(unshadow) (Addr start, Addr end, VgBF_Origin_t origin)
+{
+  VgBF_Shadowed_t* s;
+  Addr             from = start;
+
+
+  while (VG_(OSetGen_Size)(Shadowed) > 0)
+  {
+    s = VG_(OSetGen_LookupWithCmp)(Shadowed, &from, BF_(Shadowed_cmpAddr));
+
+    if (s == 0)
     {
-      VG_(message)(Vg_UserMsg, "BF: %s %d %d %d %04x %04x %04x\n",
-                   block->desc, block->type, row, col, original, mask, flipped);
+      VG_(OSetGen_ResetIterAt)(Shadowed, &from);
+      s = VG_(OSetGen_Next)(Shadowed);
     }
-  }
-  else if (size == 4)
-  {
-    UInt  mask     = BF_(getFlipMask)( 32, BF_(getFlipSize)() );
-    UInt* p        = (UInt*) addr;
-    UInt  original = *p;
-    UInt  flipped  = (original ^ mask);
 
-    *p = flipped;
-    FaultCount++;
+    if (s == 0 || s->start > end) break;
 
-    if (Verbose)
+    from = s->end + 1;
+
+    if (s->origin == origin)
     {
-      VG_(message)(Vg_UserMsg, "BF: %s %d %d %d %08x %08x %08x\n",
-                   block->desc, block->type, row, col, original, mask, flipped);
+      VG_(OSetGen_Remove)(Shadowed, &s->start);
+      VG_(OSetGen_FreeNode)(Shadowed, s);
     }
+
+    if (from == 0) break;
   }
-  else if (size == 8)
+}
+
+
+/**
+ * Marks the rows-by-cols matrix of the given element type and layout at
+ * start, passed via the Valgrind Client Request mechanism (or, for
+ * BF_ORIGIN_HEAP, by the malloc replacement), as susceptible to SEUs.
+ * The registration is attributed to where.  A client request takes
+ * precedence over the automatically registered (heap, global and
+ * stack) blocks it overlaps, which are released and, for heap and
+ * global blocks, shadowed until BF_(MemOffRequest)().
+ *
+ * @return True if the memory was registered, or False if it is empty or
+ * overlaps memory that is already registered.
+ */
+static Bool
+BF_(MemOn) (  Addr             start
+            , SizeT            rows
+            , SizeT            cols
+            , VgBF_MemType_t   type
+            , VgBF_MemOrder_t  layout
+            , const HChar*     desc
+            , ExeContext*      where
+            , VgBF_Origin_t    origin )
+{
+  SizeT            elems = rows  * cols;
+  SizeT            bytes = elems * BF_(sizeof)(type);
+  Addr             end   = start + bytes - 1;
+  VgBF_MemBlock_t* other;
+  VgBF_MemBlock_t* block;
+  Bool             isNew;
+
+
+  if (bytes == 0)
   {
-    UWord  mask     = BF_(getFlipMask)( 64, BF_(getFlipSize)() );
-    UWord* p        = (UWord*) addr;
-    UWord  original = *p;
-    UWord  flipped  = (original ^ mask);
+    VG_(message)(Vg_UserMsg,
+                 "VALGRIND_BITFLIPS_MEM_ON: %s is empty; ignored\n", desc);
+    return False;
+  }
 
-    *p = flipped;
-    FaultCount++;
+  other = BF_(MemBlock_findOverlap)(start, end);
 
-    if (Verbose)
+  // Automatic blocks are released only once the request is known not to
+  // overlap another client request
+  if (origin == BF_ORIGIN_USER)
+  {
+    while (other != 0 && other->origin != BF_ORIGIN_USER)
+    {
+      other = (other->end < end) ?
+        BF_(MemBlock_findOverlap)(other->end + 1, end) : 0;
+    }
+
+    while (other == 0 && (block = BF_(MemBlock_findOverlap)(start, end)) != 0)
     {
-      VG_(message)(Vg_UserMsg, "BF: %s %d %d %d %016lx %016lx %016lx\n",
-                   block->desc, block->type, row, col, original, mask, flipped);
+      BF_(shadow)(block);
+      BF_(MemOff)(block->start);
     }
   }
+
+  if (other != 0)
+  {
+    VG_(message)(Vg_UserMsg,
+                 "VALGRIND_BITFLIPS_MEM_ON: %s [%#lx, %#lx] overlaps "
+                 "%s [%#lx, %#lx]; ignored\n",
+                 desc, start, end, other->desc, other->start, other->end);
+    return False;
+  }
+
+  block = VG_(OSetGen_AllocNode)(MemBlocks, sizeof(VgBF_MemBlock_t));
+
+  block->start         = start;
+  block->end           = end;
+  block->num_rows      = rows;
+  block->num_cols      = cols;
+  block->num_elems     = elems;
+  block->num_bytes     = bytes;
+  block->num_kilobytes = bytes / 1000.0;
+  block->desc          = VG_(allocStrDedupPA)(Descs, desc, &isNew);
+  block->type          = type;
+  block->layout        = layout;
+  block->origin        = origin;
+  block->where         = where;
+  block->slot          = BF_(Exposure_add)(&Exposure, block, bytes);
+  block->id            = NextBlockId++;
+  block->traced        = False;
+
+  VG_(OSetGen_Insert)(MemBlocks, block);
+
+  return True;
 }
 
 
 /**
- * If FaultInjection is True, inject approximately FaultRate
- * SEUs / (KB * instruction) across eligible memory blocks.
- *
- * This function is instrumented (called) in the user's program before
- * every instruction.
+ * Deregisters the memory at start for a VALGRIND_BITFLIPS_MEM_OFF
+ * request and registers again the shadowed heap and global blocks it
+ * covered that no other client request overlaps.
  */
 static void
-BF_(doFaultCheck) (void)
+BF_(MemOffRequest) (Addr start)
 {
-  ++InstructionCount;
+  VgBF_MemBlock_t* block = VG_(OSetGen_Lookup)(MemBlocks, &start);
+  VgBF_Shadowed_t* s;
+  Addr             end;
+  Addr             from;
+
+
+  if (block == 0) return;
 
-  if (FaultInjection == True) {
+  end  = block->end;
+  from = start;
 
-    VgBF_MemBlock_t* block;
-    for (block = MemBlockHead; block != 0; block = block->next) {
+  BF_(MemOff)(start);
 
-      // The Poisson rate parameter is expected SEUs in this period of 1
-      // instruction, which is obtained by multiplying FaultRate
-      // (SEU / (KB * instruction)) by the number of KB in the block and
-      // implicltly by the 1 instruction
-      double lambda = FaultRate * block->num_kilobytes;
-      UInt n_faults = random_poisson(lambda, BF_(randomUniformDouble));
-      UInt size = BF_(sizeof)(block->type);
+  while (VG_(OSetGen_Size)(Shadowed) > 0)
+  {
+    s = VG_(OSetGen_LookupWithCmp)(Shadowed, &from, BF_(Shadowed_cmpAddr));
+
+    if (s == 0)
+    {
+      VG_(OSetGen_ResetIterAt)(Shadowed, &from);
+      s = VG_(OSetGen_Next)(Shadowed);
+    }
 
-      // Record that we've observed this block
-      KilobyteFlux += block->num_kilobytes;
+    if (s == 0 || s->start > end) break;
 
-      UInt f;
-      for (f = 0; f < n_faults; f++) {
-        UInt n = BF_(randomInt)(&RandomState, block->num_elems);
-        Addr addr = block->start + (n * size);
-        BF_(doFlipBits)(addr, size, block);
+    from = s->end + 1;
+
+    if ( BF_(MemBlock_findOverlap)(s->start, s->end) == 0 )
+    {
+      BF_(MemOn)(  s->start, s->end - s->start + 1, 1, BITFLIPS_UCHAR
+                 , BITFLIPS_ROW_MAJOR, s->desc, 0, s->origin );
+
+      if (Verbose)
+      {
+        VG_(message)(Vg_UserMsg, "restored: %s [%#lx, %#lx]\n",
+                     s->desc, s->start, s->end);
       }
 
+      VG_(OSetGen_Remove)(Shadowed, &s->start);
+      VG_(OSetGen_FreeNode)(Shadowed, s);
     }
 
+    if (from == 0) break;
   }
 }
 
 
-#if 0
 /**
- * This function is instrumented (called) in the user's program before
- * every load instruction.
+ * Registers the n regions described by descs (see
+ * VALGRIND_BITFLIPS_MEM_ON_BATCH) with a single client request.
+ *
+ * @return the number of regions that were not registered.
  */
-static VG_REGPARM(2) void
-BF_(doLoad) (Addr addr, SizeT size)
+static UWord
+BF_(MemOnBatch) (ThreadId tid, const VgBF_MemDesc_t* descs, UWord n)
 {
-  VG_(printf)("Exec: BF_(doLoad): LOAD: %p (size=%d)\n", addr, size);
-}
-#endif  /* #if 0 */
+  ExeContext*  where    = VG_(record_ExeContext)(tid, 0);
+  UWord        rejected = 0;
+  UWord        i;
 
 
-/* ------------------------------------------------------------ */
-/* -- Instrumentation Functions                              -- */
-/* ------------------------------------------------------------ */
+  for (i = 0; i < n; ++i)
+  {
+    const HChar* name = (descs[i].name != 0) ? descs[i].name : "(batch)";
 
+    if (Verbose)
+    {
+      VG_(message)(Vg_UserMsg, "VALGRIND_BITFLIPS_MEM_ON:  %s\n", name);
+    }
 
-static void
-BF_(addFaultCheck) (IRSB* bb)
-{
-  IRExpr** argv = mkIRExprVec_0();
-  IRDirty* di   = unsafeIRDirty_0_N(  0
-                                    , "BF_(doFaultCheck)" 
-				    , VG_(fnptr_to_fnentry)(&BF_(doFaultCheck))
-                                    , argv );
+    if (!BF_(MemOn)( (Addr) descs[i].addr, descs[i].rows, descs[i].cols
+                   , descs[i].type, descs[i].layout, name, where
+                   , BF_ORIGIN_USER ))
+    {
+      ++rejected;
+    }
+  }
 
-  addStmtToIRSB(bb, IRStmt_Dirty(di));
+  return rejected;
 }
 
 
-#if 0
+/**
+ * Unregisters the n regions described by descs (see
+ * VALGRIND_BITFLIPS_MEM_OFF_BATCH) with a single client request.
+ */
 static void
-BF_(addLoadCheck) (IRSB* bb, IRExpr* dAddr, Int dSize)
+BF_(MemOffBatch) (const VgBF_MemDesc_t* descs, UWord n)
 {
-  IRExpr** argv = mkIRExprVec_2(dAddr, mkIRExpr_HWord(dSize));
-  IRDirty* di   = unsafeIRDirty_0_N(  2
-                                    , "BF_(doLoad)"
-                                    , VG_(fnptr_to_fnentry)(&BF_(doLoad))
-                                    , argv );
+  UWord i;
 
-  /*
-  if (dAddr->tag == Iex_Const)
+
+  for (i = 0; i < n; ++i)
   {
-    IRConst* constant = (IRConst*) dAddr->Iex.Const.con;
-    ULong    address  = (ULong)    constant->Ico.U64;
-    VG_(printf)("\nInst: BF_(onLoad): dAddr=0x%llx\n", address);
-  }
-  */
+    if (Verbose)
+    {
+      VG_(message)(Vg_UserMsg, "VALGRIND_BITFLIPS_MEM_OFF: %s\n",
+                   (descs[i].name != 0) ? descs[i].name : "(batch)");
+    }
 
-  addStmtToIRSB(bb, IRStmt_Dirty(di));
+    BF_(MemOffRequest)( (Addr) descs[i].addr );
+  }
 }
-#endif  /* #if 0 */
 
 
 /**
- * Main instrumentation function
+ * @return a bit flip mask width bits wide (width <= 64) with flips
+ * distinct bits flipped, chosen uniformly among all such masks.
+ *
+ * Uses Floyd's sampling algorithm, which needs one bounded random draw
+ * per flipped bit regardless of width, drawing the complement instead
+ * when more than half the bits flip.
  */
-static IRSB*
-BF_(instrument) (  VgCallbackClosure* closure
-                 , IRSB*              bbIn
-                 , const VexGuestLayout*    layout
-                 , const VexGuestExtents*   vge
-                 , const VexArchInfo*       archinfo_host
-                 , IRType             gWordTy
-                 , IRType             hWordTy )
+static ULong
+BF_(getFlipMask) (UInt width, UInt flips)
 {
-  Int n;
+  ULong all  = (width >= 64) ? ~0ULL : ~((~0ULL) << width);
+  ULong mask = 0;
+  ULong bit;
+  UInt  j;
 
-  IRSB* bbOut      = emptyIRSB();
-  bbOut->tyenv     = deepCopyIRTypeEnv(bbIn->tyenv);
-  bbOut->next      = deepCopyIRExpr(bbIn->next);
-  bbOut->jumpkind  = bbIn->jumpkind;
-  bbOut->offsIP    = bbIn->offsIP;
-  
 
-  for (n = 0; n < bbIn->stmts_used; ++n)
+  if (flips >= width)    return all;
+  if (2 * flips > width) return all & ~BF_(getFlipMask)(width, width - flips);
+
+  for (j = width - flips; j < width; ++j)
   {
-    IRStmt* statement = bbIn->stmts[n];
+    bit   = 1ULL << BF_(Random_below32)(j + 1);
+    mask |= (mask & bit) ? (1ULL << j) : bit;
+  }
 
-    if (!statement || statement->tag == Ist_NoOp) continue;
+  return mask;
+}
 
-    BF_(addFaultCheck)(bbOut);
 
-    /*
-    if (statement->tag == Ist_Tmp)
-    {
-      IRExpr* data = statement->Ist.Tmp.data;
-      if (data->tag == Iex_Load)
+/**
+ * @return the number of bits to flip, drawn from the FlipDensity
+ * distribution.
+ */
+static UInt
+BF_(getFlipSize) (void)
+{
+  return BF_(Alias_draw)(&FlipDensity);
+}
+
+
+/**
+ * Accumulates the FLOAT and DOUBLE fault statistics reported by
+ * BF_(finalize)().
+ */
+static void
+BF_(recordFloatFault) (const VgBF_FlipValue_t* value)
+{
+  FloatFaultCount++;
+
+  if ( !BF_(Value_isFinite)(value->flipped) )
+  {
+    NonFiniteCount++;
+  }
+  else if ( BF_(Value_isFinite)(value->relerr) && value->relerr > MaxRelError )
+  {
+    MaxRelError = value->relerr;
+  }
+}
+
+
+/**
+ * Reports the flip of the bits in mask of the element (size bytes
+ * wide) at (row, col) of block from original to flipped: records its
+ * value statistics and trace record and, with --verbose=yes, prints the
+ * raw bits followed by the element's original and flipped values,
+ * delta and relative error.
+ */
+static void
+BF_(reportFlip) (  VgBF_MemBlock_t* block
+                 , UInt             row
+                 , UInt             col
+                 , SizeT            size
+                 , ULong            original
+                 , ULong            mask
+                 , ULong            flipped )
+{
+  const HChar*     fmt;
+  VgBF_FlipValue_t value;
+
+
+  switch (size)
+  {
+    case 1:
+      fmt = "BF: %s %u %u %u %02llx %02llx %02llx %s %s %s %s\n";
+      break;
+
+    case 2:
+      fmt = "BF: %s %u %u %u %04llx %04llx %04llx %s %s %s %s\n";
+      break;
+
+    case 4:
+      fmt = "BF: %s %u %u %u %08llx %08llx %08llx %s %s %s %s\n";
+      break;
+
+    default:
+      fmt = "BF: %s %u %u %u %016llx %016llx %016llx %s %s %s %s\n";
+      break;
+  }
+
+  BF_(Value_flip)(&value, block->type, original, flipped);
+
+  // The float statistics describe memory SEUs only
+  if (block->origin != BF_ORIGIN_REGISTER &&
+      (block->type == BITFLIPS_FLOAT || block->type == BITFLIPS_DOUBLE))
+  {
+    BF_(recordFloatFault)(&value);
+  }
+
+  BF_(Trace_fault)(block, InstructionCount, row, col,
+                   original, mask, flipped, &value);
+
+  if (Verbose)
+  {
+    UInt  precision = (block->type == BITFLIPS_FLOAT) ? 8 : 14;
+    HChar o[BF_VALUE_FORMAT_SIZE];
+    HChar f[BF_VALUE_FORMAT_SIZE];
+    HChar d[BF_VALUE_FORMAT_SIZE];
+    HChar r[BF_VALUE_FORMAT_SIZE];
+
+    BF_(Value_format)(o, value.original, precision);
+    BF_(Value_format)(f, value.flipped , precision);
+    BF_(Value_format)(d, value.delta   , 4);
+    BF_(Value_format)(r, value.relerr  , 4);
+
+    VG_(message)(Vg_UserMsg, fmt, block->desc, block->type, row, col,
+                 original, mask, flipped, o, f, d, r);
+  }
+}
+
+
+/**
+ * Flips the bits in mask of the element at the given address (size
+ * bytes wide).  The MemBlock containing addr is passed-in for reporting
+ * purposes (see BF_(reportFlip)).
+ */
+static void
+BF_(applyFlip) (Addr addr, SizeT size, VgBF_MemBlock_t* block, ULong mask)
+{
+  ULong original;
+  ULong flipped;
+
+
+  if (size == 1)
+  {
+    UChar* p = (UChar*) addr;
+
+    original = *p;
+    flipped  = (original ^ mask);
+    *p       = (UChar) flipped;
+  }
+  else if (size == 2)
+  {
+    UShort* p = (UShort*) addr;
+
+    original = *p;
+    flipped  = (original ^ mask);
+    *p       = (UShort) flipped;
+  }
+  else if (size == 4)
+  {
+    UInt* p = (UInt*) addr;
+
+    original = *p;
+    flipped  = (original ^ mask);
+    *p       = (UInt) flipped;
+  }
+  else if (size == 8)
+  {
+    ULong* p = (ULong*) addr;
+
+    original = *p;
+    flipped  = (original ^ mask);
+    *p       = flipped;
+  }
+  else
+  {
+    return;
+  }
+
+  FaultCount++;
+
+  BF_(reportFlip)(block, BF_(MemBlock_getRow)(block, addr),
+                  BF_(MemBlock_getCol)(block, addr),
+                  size, original, mask, flipped);
+}
+
+
+/**
+ * Records an SEU flipping the bits in mask of the element at addr as
+ * pending under BF_INJECT_LAZY, merging it with any SEU already
+ * pending there.  Merged SEUs whose flips cancel out are masked.
+ */
+static void
+BF_(addPending) (Addr addr, SizeT size, VgBF_MemBlock_t* block, ULong mask)
+{
+  VgBF_Pending_t* p = VG_(OSetGen_Lookup)(Pending, &addr);
+
+
+  LazyScheduled++;
+
+  if (p != 0)
+  {
+    p->mask ^= mask;
+    p->events++;
+
+    // The flips cancelled out, so nothing is left to activate
+    if (p->mask == 0)
+    {
+      LazyMasked += p->events;
+      BF_(removePending)(p);
+    }
+
+    return;
+  }
+
+  p         = VG_(OSetGen_AllocNode)(Pending, sizeof(VgBF_Pending_t));
+  p->addr   = addr;
+  p->size   = size;
+  p->events = 1;
+  p->mask   = mask;
+  p->block  = block;
+
+  VG_(OSetGen_Insert)(Pending, p);
+  ++PendingCount;
+}
+
+
+/**
+ * Flips one or more bits (governed by BF_(getFlipSize)() and the
+ * FlipDensity PDF) of the element at the given address (size bytes
+ * wide) in block, now or, under BF_INJECT_LAZY, when it is next read.
+ */
+static void
+BF_(doFlipBits) (Addr addr, SizeT size, VgBF_MemBlock_t* block)
+{
+  ULong mask = BF_(getFlipMask)( 8 * size, BF_(getFlipSize)() );
+
+
+  if (InjectMode == BF_INJECT_LAZY)
+  {
+    BF_(addPending)(addr, size, block, mask);
+  }
+  else
+  {
+    BF_(applyFlip)(addr, size, block, mask);
+  }
+}
+
+
+/**
+ * Applies the SEUs pending in elements overlapping the size bytes at
+ * addr, which the guest is about to read.  A size of zero is a guarded
+ * access that is not made.
+ *
+ * This function is instrumented (called) in the user's program before
+ * every load under BF_INJECT_LAZY, while PendingCount is non-zero.
+ */
+static VG_REGPARM(2) void
+BF_(doLoad) (Addr addr, SizeT size)
+{
+  VgBF_Pending_t* p;
+  Addr            from = (addr > 7) ? addr - 7 : 0;
+
+
+  if (size == 0) return;
+
+  while ( (p = BF_(nextPending)(&from, addr, size)) != 0 )
+  {
+    LazyActivated += p->events;
+    BF_(applyFlip)(p->addr, p->size, p->block, p->mask);
+    BF_(removePending)(p);
+  }
+}
+
+
+/**
+ * Clears from the SEUs pending in elements overlapping the size bytes
+ * at addr the bits that the guest is about to overwrite, counting an
+ * SEU as masked once none of its flipped bits remain.
+ *
+ * This function is instrumented (called) in the user's program before
+ * every store under BF_INJECT_LAZY, while PendingCount is non-zero.
+ */
+static VG_REGPARM(2) void
+BF_(doStore) (Addr addr, SizeT size)
+{
+  VgBF_Pending_t* p;
+  Addr            from = (addr > 7) ? addr - 7 : 0;
+  UInt            k;
+  UInt            shift;
+
+
+  if (size == 0) return;
+
+  while ( (p = BF_(nextPending)(&from, addr, size)) != 0 )
+  {
+    for (k = 0; k < p->size; ++k)
+    {
+      if (p->addr + k >= addr && p->addr + k < addr + size)
+      {
+#if defined(VG_BIGENDIAN)
+        shift = 8 * (p->size - 1 - k);
+#else
+        shift = 8 * k;
+#endif
+        p->mask &= ~(0xFFULL << shift);
+      }
+    }
+
+    if (p->mask == 0)
+    {
+      if (Verbose)
+      {
+        VG_(message)(Vg_UserMsg, "BF masked: %s %u %u %u\n",
+                     p->block->desc, p->block->type,
+                     BF_(MemBlock_getRow)(p->block, p->addr),
+                     BF_(MemBlock_getCol)(p->block, p->addr));
+      }
+
+      LazyMasked += p->events;
+      BF_(removePending)(p);
+    }
+  }
+}
+
+
+/**
+ * Applies the SEUs pending in the size bytes at a, which the kernel is
+ * about to read for a system call, as BF_(doLoad) does for the guest.
+ */
+static void
+BF_(preSyscallRead) (  CorePart      part
+                     , ThreadId      tid
+                     , const HChar*  what
+                     , Addr          a
+                     , SizeT         size )
+{
+  if (PendingCount != 0) BF_(doLoad)(a, size);
+}
+
+
+/**
+ * Applies the SEUs pending in the NUL-terminated string at a, which the
+ * kernel is about to read for a system call.
+ */
+static void
+BF_(preSyscallReadString) (  CorePart      part
+                           , ThreadId      tid
+                           , const HChar*  what
+                           , Addr          a )
+{
+  if (PendingCount != 0) BF_(doLoad)(a, VG_(strlen)((const HChar*) a) + 1);
+}
+
+
+/**
+ * Masks the SEUs pending in the size bytes at a, which the kernel has
+ * just overwritten for a system call, as BF_(doStore) does for the
+ * guest.
+ */
+static void
+BF_(postSyscallWrite) (CorePart part, ThreadId tid, Addr a, SizeT size)
+{
+  if (PendingCount != 0) BF_(doStore)(a, size);
+}
+
+
+/**
+ * XORs masks[i] into the i-th of the n consecutive elements (size bytes
+ * wide) at addr, in one pass over the range.
+ */
+static void
+BF_(xorRange) (Addr addr, UInt size, const ULong* masks, UInt n)
+{
+  UInt i;
+
+
+  switch (size)
+  {
+    case 1:
+    {
+      UChar* p = (UChar*) addr;
+      for (i = 0; i < n; ++i) p[i] ^= (UChar) masks[i];
+      break;
+    }
+
+    case 2:
+    {
+      UShort* p = (UShort*) addr;
+      for (i = 0; i < n; ++i) p[i] ^= (UShort) masks[i];
+      break;
+    }
+
+    case 4:
+    {
+      UInt* p = (UInt*) addr;
+      for (i = 0; i < n; ++i) p[i] ^= (UInt) masks[i];
+      break;
+    }
+
+    case 8:
+    {
+      ULong* p = (ULong*) addr;
+      for (i = 0; i < n; ++i) p[i] ^= masks[i];
+      break;
+    }
+  }
+}
+
+
+/**
+ * @return the element (size bytes wide) at addr, in the low-order bits.
+ */
+static ULong
+BF_(readElement) (Addr addr, UInt size)
+{
+  switch (size)
+  {
+    case 1:  return *(UChar*)  addr;
+    case 2:  return *(UShort*) addr;
+    case 4:  return *(UInt*)   addr;
+    default: return *(ULong*)  addr;
+  }
+}
+
+
+/**
+ * Injects one multi-cell upset (--mcu-density) starting at a uniformly
+ * chosen bit of the byte at offset within of block: a cluster of
+ * physically adjacent bits, its length drawn from McuDensity, that may
+ * spill into the following elements.  Under --mcu-interleave=k the
+ * physically adjacent cells belong in turn to k consecutive elements,
+ * so bit q of the cluster lands in element e0 + q % k at bit b0 + q / k,
+ * carrying k elements further on past the element's top bit.  Bits that
+ * fall past the end of the block are lost.
+ *
+ * Each element hit is flipped (or, under BF_INJECT_LAZY, made pending)
+ * and reported as one SEU; McuEvents counts the clusters.
+ */
+static void
+BF_(doBurst) (VgBF_MemBlock_t* block, ULong within)
+{
+  UInt  size  = BF_(sizeof)(block->type);
+  UInt  width = 8 * size;
+  UInt  len   = BF_(Alias_draw)(&McuDensity);
+  ULong e0    = within / size;
+  Addr  start = block->start + e0 * size;
+  UInt  last  = 0;
+  UInt  b0;
+  UInt  bit;
+  UInt  q;
+  UInt  i;
+
+
+#if defined(VG_BIGENDIAN)
+  b0 = 8 * (size - 1 - within % size) + BF_(Random_below32)(8);
+#else
+  b0 = 8 * (within % size) + BF_(Random_below32)(8);
+#endif
+
+  McuEvents++;
+
+  for (q = 0; q < len; ++q)
+  {
+    bit = b0 + q / McuInterleave;
+    i   = q % McuInterleave + McuInterleave * (bit / width);
+
+    if (i >= BF_MAX_MCU_SPAN || e0 + i >= block->num_elems) continue;
+
+    McuMasks[i] |= 1ULL << (bit % width);
+    if (i > last) last = i;
+  }
+
+  if (InjectMode == BF_INJECT_LAZY)
+  {
+    for (i = 0; i <= last; ++i)
+    {
+      if (McuMasks[i] != 0)
+      {
+        BF_(addPending)(start + i * size, size, block, McuMasks[i]);
+      }
+    }
+  }
+  else
+  {
+    BF_(xorRange)(start, size, McuMasks, last + 1);
+
+    for (i = 0; i <= last; ++i)
+    {
+      if (McuMasks[i] != 0)
+      {
+        Addr  addr    = start + i * size;
+        ULong flipped = BF_(readElement)(addr, size);
+
+        FaultCount++;
+        BF_(reportFlip)(block, BF_(MemBlock_getRow)(block, addr),
+                        BF_(MemBlock_getCol)(block, addr), size,
+                        flipped ^ McuMasks[i], McuMasks[i], flipped);
+      }
+    }
+  }
+
+  VG_(memset)(McuMasks, 0, (last + 1) * sizeof(ULong));
+}
+
+
+/**
+ * Injects one SEU into the exposed memory.  A single uniform byte
+ * offset into all exposed memory selects both the victim block (with
+ * probability proportional to its size) and the element within it.
+ * With --mcu-density, the SEU is a multi-cell upset (see BF_(doBurst)).
+ */
+static void
+BF_(injectFault) (void)
+{
+  ULong            within;
+  VgBF_MemBlock_t* block;
+
+
+  if (Exposure.total == 0) return;
+
+  block = BF_(Exposure_find)(&Exposure,
+                             BF_(Random_below64)(Exposure.total), &within);
+
+  if (block != 0 && McuDensitySpec != 0)
+  {
+    BF_(doBurst)(block, within);
+  }
+  else if (block != 0)
+  {
+    UInt size = BF_(sizeof)(block->type);
+    BF_(doFlipBits)(block->start + within - (within % size), size, block);
+  }
+}
+
+
+/**
+ * @return a Poisson sampler for the number of SEUs expected in a period
+ * of n instructions with the current ExposedKilobytes, or null if n is
+ * too large to be cached.
+ */
+static const random_poisson_sampler*
+BF_(getSampler) (ULong n)
+{
+  VgBF_Sampler_t* cached;
+
+
+  if (n >= BF_SAMPLER_CACHE) return 0;
+
+  cached = &Samplers[n];
+
+  if (cached->generation != ExposureGeneration)
+  {
+    random_poisson_sampler_init(&cached->sampler,
+                                FaultRate * ExposedKilobytes * n);
+    cached->generation = ExposureGeneration;
+  }
+
+  return &cached->sampler;
+}
+
+
+/**
+ * Injects the SEUs accumulated over a period of n instructions under
+ * BF_SCHEDULE_POISSON.  The per-block Poisson counts are independent,
+ * so their sum is a single Poisson draw over ExposedKilobytes with each
+ * fault landing in a block in proportion to its size.
+ */
+static void
+BF_(doPoissonFaults) (ULong n)
+{
+  // The Poisson rate parameter is expected SEUs in this period of n
+  // instructions, which is obtained by multiplying FaultRate
+  // (SEU / (KB * instruction)) by the number of exposed KB and by the
+  // n instructions
+  const random_poisson_sampler* sampler = BF_(getSampler)(n);
+  UInt                          n_faults;
+  UInt                          f;
+
+
+  n_faults = (sampler != 0) ?
+    random_poisson_sampler_draw(sampler, BF_(Random_uniform)) :
+    random_poisson(FaultRate * ExposedKilobytes * n, BF_(Random_uniform));
+
+  // Record that we've observed the exposed blocks
+  KilobyteFlux += ExposedKilobytes * n;
+
+  for (f = 0; f < n_faults; f++)
+  {
+    BF_(injectFault)();
+  }
+}
+
+
+/**
+ * If FaultInjection is True, inject approximately FaultRate
+ * SEUs / (KB * instruction) across eligible memory blocks.
+ *
+ * This function is instrumented (called) in the user's program before
+ * every instruction.
+ */
+static void
+BF_(doFaultCheck) (void)
+{
+  ++InstructionCount;
+
+  if (ExposedKilobytes > 0) {
+    BF_(doPoissonFaults)(1);
+  }
+}
+
+
+/**
+ * @return the number of instructions up to and including the next one
+ * on which at least one SEU occurs, given ExposedKilobytes of exposed
+ * memory (see random_poisson_gap()).
+ */
+static ULong
+BF_(drawFaultGap) (void)
+{
+  return random_poisson_gap(FaultRate * ExposedKilobytes,
+                            BF_(Random_uniform));
+}
+
+
+/**
+ * Counterpart of BF_(drawFaultGap) for register SEUs: @return the
+ * number of instructions up to and including the next one on which at
+ * least one SEU hits the RegisterBytes of exposed registers, or ~0 while
+ * FaultInjection is off.
+ */
+static ULong
+BF_(drawRegisterGap) (void)
+{
+  if (!FaultInjection) return ~0ULL;
+
+  return random_poisson_gap(RegisterFaultRate * 8 * RegisterBytes,
+                            BF_(Random_uniform));
+}
+
+
+/**
+ * Implements --skip-idle.  While Idle, no SEU can occur and none is
+ * pending, so BF_(instrument)() leaves code uninstrumented.  On every
+ * change of state, all existing translations are discarded (as
+ * Callgrind does when instrumentation is toggled) so that code is
+ * retranslated with or without fault checks.  See BF_(reschedule)() for
+ * when the state changes.
+ */
+static void
+BF_(setIdle) (Bool idle)
+{
+  if (idle != Idle)
+  {
+    Idle = idle;
+    VG_(discard_translations_safely)((Addr) 0x1000, ~(SizeT) 0xfff,
+                                     "bitflips");
+
+    if (Verbose)
+    {
+      VG_(message)(Vg_UserMsg, "skip-idle: %s\n",
+                   idle ? "idle" : "instrumenting");
+    }
+  }
+}
+
+
+/**
+ * Recomputes ExposedKilobytes from the exposure table and, under
+ * BF_SCHEDULE_SKIP, credits KilobyteFlux with the exposure accumulated
+ * since the last reschedule and restarts the countdown to the next
+ * faulty instruction.  Must be called whenever the set of exposed blocks
+ * or FaultInjection changes.  Also restarts the register SEU countdown
+ * and enters or leaves the --skip-idle Idle state.
+ */
+static void
+BF_(reschedule) (void)
+{
+  double exposed;
+
+
+  if (FaultSchedule == BF_SCHEDULE_SKIP)
+  {
+    KilobyteFlux += ExposedKilobytes * (InstructionCount - ScheduleStart);
+    ScheduleStart = InstructionCount;
+  }
+
+  exposed = (FaultInjection == True) ? Exposure.total / 1000.0 : 0.0;
+
+  if (exposed != ExposedKilobytes)
+  {
+    ExposedKilobytes = exposed;
+    ++ExposureGeneration;
+  }
+
+  if (FaultSchedule == BF_SCHEDULE_SKIP)
+  {
+    FaultCountdown = BF_(drawFaultGap)();
+  }
+
+  if (RegisterFaultRate > 0)
+  {
+    RegisterCountdown = BF_(drawRegisterGap)();
+  }
+
+  // Leave Idle as soon as an SEU can occur, but only return to it when
+  // injection is turned off: exposure churn while injecting (MEM_ON and
+  // MEM_OFF, or malloc and free with --expose-heap) would otherwise
+  // discard every translation twice per cycle
+  if (SkipIdle)
+  {
+    if ((ExposedKilobytes > 0 && FaultRate > 0) ||
+        RegisterCountdown != ~0ULL || PendingCount > 0)
+    {
+      BF_(setIdle)(False);
+    }
+    else if (!FaultInjection)
+    {
+      BF_(setIdle)(True);
+    }
+  }
+}
+
+
+/**
+ * Injects the faults due on the current instruction under
+ * BF_SCHEDULE_SKIP.  At least one fault occurs; each is assigned to a
+ * block with probability proportional to its size, which is equivalent
+ * to drawing an independent Poisson count for every block.
+ */
+static void
+BF_(doScheduledFaults) (void)
+{
+  const random_poisson_sampler* sampler  = BF_(getSampler)(1);
+  UInt                          n_faults =
+    random_poisson_sampler_draw_positive(sampler, BF_(Random_uniform));
+  UInt                          f;
+
+
+  for (f = 0; f < n_faults; f++)
+  {
+    BF_(injectFault)();
+  }
+
+  BF_(reschedule)();
+}
+
+
+/**
+ * Counterpart of BF_(doFaultCheck) for BF_SCHEDULE_SKIP: instead of a
+ * Poisson draw per block it only counts down to the next instruction on
+ * which a fault is due.
+ *
+ * This function is instrumented (called) in the user's program before
+ * every instruction.
+ */
+static void
+BF_(doScheduledCheck) (void)
+{
+  ++InstructionCount;
+
+  if (--FaultCountdown == 0)
+  {
+    BF_(doScheduledFaults)();
+  }
+}
+
+
+/**
+ * Batched counterpart of BF_(doFaultCheck) and BF_(doScheduledCheck)
+ * for BF_CHECK_SUPERBLOCK: accounts for n instructions at once.  Under
+ * BF_SCHEDULE_POISSON a single Poisson draw per block covers all n
+ * instructions; under BF_SCHEDULE_SKIP every fault that falls due
+ * within them is injected.
+ *
+ * This function is instrumented (called) in the user's program before
+ * every superblock exit.
+ */
+static VG_REGPARM(1) void
+BF_(doFaultCheckN) (UWord n)
+{
+  // A register SEU in the superblock has accounted for FlushedCount of
+  // them already
+  n            -= FlushedCount;
+  FlushedCount  = 0;
+
+  if (FaultSchedule == BF_SCHEDULE_SKIP)
+  {
+    while (n >= FaultCountdown)
+    {
+      InstructionCount += FaultCountdown;
+      n                -= FaultCountdown;
+      FaultCountdown    = 0;
+      BF_(doScheduledFaults)();
+    }
+
+    InstructionCount += n;
+    FaultCountdown   -= n;
+  }
+  else
+  {
+    InstructionCount += n;
+
+    if (ExposedKilobytes > 0)
+    {
+      BF_(doPoissonFaults)(n);
+    }
+  }
+}
+
+
+/**
+ * Flips bits in a lane of a guest register of the running thread,
+ * chosen uniformly among all RegisterBytes exposed register bytes.
+ * Register SEUs are counted in RegisterFaultCount, not FaultCount.
+ */
+static void
+BF_(injectRegisterFault) (ThreadId tid)
+{
+  ULong            offset = BF_(Random_below64)(RegisterBytes);
+  VgBF_RegGroup_t* group  = 0;
+  UInt             lanes;
+  UInt             lane;
+  UInt             size;
+  ULong            mask;
+  ULong            original;
+  ULong            flipped;
+  Int              g;
+  union { UInt u32; ULong u64; } bits;
+
+
+  for (g = 0; g < BF_REG_GROUPS; ++g)
+  {
+    group = &RegGroups[g];
+    if (offset < (ULong) group->count * group->size) break;
+    offset -= (ULong) group->count * group->size;
+  }
+
+  if (g == BF_REG_GROUPS) return;
+
+  size   = BF_(sizeof)(group->type);
+  lanes  = group->size / size;
+  lane   = offset / size;
+  offset = group->offset + (ULong) lane * size;
+  mask   = BF_(getFlipMask)( 8 * size, BF_(getFlipSize)() );
+
+  VG_(get_shadow_regs_area)(tid, (UChar*) &bits, 0, offset, size);
+
+  original = (size == 4) ? bits.u32 : bits.u64;
+  flipped  = original ^ mask;
+
+  if (size == 4) bits.u32 = (UInt) flipped;
+  else           bits.u64 = flipped;
+
+  VG_(set_shadow_regs_area)(tid, 0, offset, size, (UChar*) &bits);
+
+  RegisterFaultCount++;
+
+  BF_(reportFlip)(&group->block, lane / lanes, lane % lanes, size,
+                  original, mask, flipped);
+}
+
+
+/**
+ * Injects the register SEUs due on the current instruction (at least
+ * one) and restarts the countdown to the next.  Under
+ * BF_CHECK_SUPERBLOCK, the pending instructions of the superblock so
+ * far, up to and including this one, are first accounted for, so that
+ * the SEUs are reported and traced at the right instruction count.  The
+ * superblock's next BF_(doFaultCheckN) then skips them.
+ *
+ * This function is instrumented (called) in the user's program when
+ * RegisterCountdown reaches zero; its IRDirty declares that it modifies
+ * the exposed registers, so they are in the guest state when it runs.
+ */
+static VG_REGPARM(1) void
+BF_(doRegisterFaults) (UWord pending)
+{
+  ThreadId tid      = VG_(get_running_tid)();
+  UInt     n_faults;
+  UInt     f;
+
+
+  if (pending > FlushedCount)
+  {
+    UWord n = pending - FlushedCount;
+
+    FlushedCount = 0;
+    BF_(doFaultCheckN)(n);
+    FlushedCount = pending;
+  }
+
+  n_faults = random_poisson_sampler_draw_positive(&RegisterSampler,
+                                                  BF_(Random_uniform));
+
+  for (f = 0; f < n_faults; f++)
+  {
+    BF_(injectRegisterFault)(tid);
+  }
+
+  RegisterCountdown = BF_(drawRegisterGap)();
+}
+
+
+/**
+ * Sets up RegGroups and RegisterBytes for --register-fault-rate.
+ */
+static void
+BF_(initRegisters) (void)
+{
+  Int g;
+
+
+  if (RegisterFaultRate == 0) return;
+
+  if (BF_REG_GROUPS == 0)
+  {
+    VG_(fmsg_bad_option)("--register-fault-rate",
+                         "register SEUs are not supported on this platform\n");
+  }
+
+  for (g = 0; g < BF_REG_GROUPS; ++g)
+  {
+    VgBF_RegGroup_t* group = &RegGroups[g];
+    VgBF_MemBlock_t* block = &group->block;
+    UInt             lanes = group->size / BF_(sizeof)(group->type);
+
+    block->start         = group->offset;
+    block->end           = group->offset + group->count * group->size - 1;
+    block->num_rows      = group->count;
+    block->num_cols      = lanes;
+    block->num_elems     = group->count * lanes;
+    block->num_bytes     = group->count * group->size;
+    block->num_kilobytes = block->num_bytes / 1000.0;
+    block->desc          = group->name;
+    block->type          = group->type;
+    block->layout        = BITFLIPS_ROW_MAJOR;
+    block->origin        = BF_ORIGIN_REGISTER;
+    block->id            = NextBlockId++;
+
+    RegisterBytes += block->num_bytes;
+  }
+
+  random_poisson_sampler_init(&RegisterSampler,
+                              RegisterFaultRate * 8 * RegisterBytes);
+}
+
+
+/* ------------------------------------------------------------ */
+/* -- Instrumentation Functions                              -- */
+/* ------------------------------------------------------------ */
+
+
+/**
+ * Adds IR to bb that updates the 64-bit counter at addr to
+ * (counter op delta) and returns the temporary holding the new value.
+ */
+static IRTemp
+BF_(addCounterUpdate) (IRSB* bb, ULong* addr, ULong delta, IROp op)
+{
+  IRExpr* where = mkIRExpr_HWord( (HWord) addr );
+  IRTemp  old   = newIRTemp(bb->tyenv, Ity_I64);
+  IRTemp  new   = newIRTemp(bb->tyenv, Ity_I64);
+
+
+  addStmtToIRSB(bb, IRStmt_WrTmp(old, IRExpr_Load(BF_END, Ity_I64, where)));
+  addStmtToIRSB(bb, IRStmt_WrTmp(new,
+                                 IRExpr_Binop(op, IRExpr_RdTmp(old),
+                                   IRExpr_Const(IRConst_U64(delta)))));
+  addStmtToIRSB(bb, IRStmt_Store(BF_END, where, IRExpr_RdTmp(new)));
+
+  return new;
+}
+
+
+/**
+ * Inline equivalent of BF_(doScheduledCheck): counts the instruction and
+ * decrements FaultCountdown in IR, calling BF_(doScheduledFaults) only
+ * when the countdown reaches zero.
+ */
+static void
+BF_(addInlineFaultCheck) (IRSB* bb)
+{
+  IRTemp   left;
+  IRTemp   due;
+  IRDirty* di;
+
+
+  BF_(addCounterUpdate)(bb, &InstructionCount, 1, Iop_Add64);
+  left = BF_(addCounterUpdate)(bb, &FaultCountdown, 1, Iop_Sub64);
+
+  due  = newIRTemp(bb->tyenv, Ity_I1);
+  addStmtToIRSB(bb, IRStmt_WrTmp(due,
+                                 IRExpr_Binop(Iop_CmpEQ64, IRExpr_RdTmp(left),
+                                   IRExpr_Const(IRConst_U64(0)))));
+
+  di = unsafeIRDirty_0_N(  0
+                         , "BF_(doScheduledFaults)"
+                         , VG_(fnptr_to_fnentry)(&BF_(doScheduledFaults))
+                         , mkIRExprVec_0() );
+  di->guard = IRExpr_RdTmp(due);
+
+  addStmtToIRSB(bb, IRStmt_Dirty(di));
+}
+
+
+static void
+BF_(addFaultCheck) (IRSB* bb)
+{
+  IRExpr** argv = mkIRExprVec_0();
+  IRDirty* di;
+
+
+  if (FaultCheck == BF_CHECK_INLINE)
+  {
+    BF_(addInlineFaultCheck)(bb);
+    return;
+  }
+
+  if (FaultSchedule == BF_SCHEDULE_SKIP)
+  {
+    di = unsafeIRDirty_0_N(  0
+                           , "BF_(doScheduledCheck)"
+                           , VG_(fnptr_to_fnentry)(&BF_(doScheduledCheck))
+                           , argv );
+  }
+  else
+  {
+    di = unsafeIRDirty_0_N(  0
+                           , "BF_(doFaultCheck)" 
+                           , VG_(fnptr_to_fnentry)(&BF_(doFaultCheck))
+                           , argv );
+  }
+
+  addStmtToIRSB(bb, IRStmt_Dirty(di));
+}
+
+
+/**
+ * Adds IR to bb that decrements RegisterCountdown and calls
+ * BF_(doRegisterFaults) when it reaches zero, with the pending
+ * instructions not yet accounted for by a BF_(doFaultCheckN).  The call
+ * declares that it modifies every exposed register group, so VEX writes
+ * them back to the guest state before it and reloads them after it.
+ */
+static void
+BF_(addRegisterCheck) (IRSB* bb, UInt pending)
+{
+  IRTemp   left = BF_(addCounterUpdate)(bb, &RegisterCountdown, 1, Iop_Sub64);
+  IRTemp   due  = newIRTemp(bb->tyenv, Ity_I1);
+  IRDirty* di;
+  Int      g;
+
+
+  addStmtToIRSB(bb, IRStmt_WrTmp(due,
+                                 IRExpr_Binop(Iop_CmpEQ64, IRExpr_RdTmp(left),
+                                   IRExpr_Const(IRConst_U64(0)))));
+
+  di = unsafeIRDirty_0_N(  1
+                         , "BF_(doRegisterFaults)"
+                         , VG_(fnptr_to_fnentry)(&BF_(doRegisterFaults))
+                         , mkIRExprVec_1( mkIRExpr_HWord(pending) ) );
+  di->guard    = IRExpr_RdTmp(due);
+  di->nFxState = BF_REG_GROUPS;
+
+  for (g = 0; g < BF_REG_GROUPS; ++g)
+  {
+    di->fxState[g].fx        = Ifx_Modify;
+    di->fxState[g].offset    = RegGroups[g].offset;
+    di->fxState[g].size      = RegGroups[g].count * RegGroups[g].size;
+    di->fxState[g].nRepeats  = 0;
+    di->fxState[g].repeatLen = 0;
+  }
+
+  addStmtToIRSB(bb, IRStmt_Dirty(di));
+}
+
+
+/**
+ * Adds a call to BF_(doFaultCheckN) accounting for count instructions.
+ */
+static void
+BF_(addFaultCheckN) (IRSB* bb, UInt count)
+{
+  IRExpr** argv = mkIRExprVec_1( mkIRExpr_HWord(count) );
+  IRDirty* di   = unsafeIRDirty_0_N(  1
+                                    , "BF_(doFaultCheckN)"
+                                    , VG_(fnptr_to_fnentry)(&BF_(doFaultCheckN))
+                                    , argv );
+
+  addStmtToIRSB(bb, IRStmt_Dirty(di));
+}
+
+
+/**
+ * Adds a call to BF_(doLoad) (or, if store, BF_(doStore)) for an access
+ * of size bytes at addr (an IR atom), guarded so that it is only made
+ * while PendingCount is non-zero.  If guard is not null (0), the access
+ * itself is guarded and a size of zero is passed when it is false.
+ */
+static void
+BF_(addAccessCheck) (  IRSB*   bb
+                     , IRExpr* addr
+                     , Int     size
+                     , IRExpr* guard
+                     , Bool    store )
+{
+  IRExpr*  where = mkIRExpr_HWord( (HWord) &PendingCount );
+  IRTemp   count = newIRTemp(bb->tyenv, Ity_I64);
+  IRTemp   any   = newIRTemp(bb->tyenv, Ity_I1);
+  IRExpr*  bytes = mkIRExpr_HWord(size);
+  IRDirty* di;
+
+
+  if (guard != 0)
+  {
+    IRTemp t = newIRTemp(bb->tyenv, typeOfIRExpr(bb->tyenv, bytes));
+
+    addStmtToIRSB(bb, IRStmt_WrTmp(t, IRExpr_ITE(guard, bytes,
+                                                 mkIRExpr_HWord(0))));
+    bytes = IRExpr_RdTmp(t);
+  }
+
+  addStmtToIRSB(bb, IRStmt_WrTmp(count, IRExpr_Load(BF_END, Ity_I64, where)));
+  addStmtToIRSB(bb, IRStmt_WrTmp(any,
+                                 IRExpr_Binop(Iop_CmpNE64, IRExpr_RdTmp(count),
+                                   IRExpr_Const(IRConst_U64(0)))));
+
+  if (store)
+  {
+    di = unsafeIRDirty_0_N(  2
+                           , "BF_(doStore)"
+                           , VG_(fnptr_to_fnentry)(&BF_(doStore))
+                           , mkIRExprVec_2(addr, bytes) );
+  }
+  else
+  {
+    di = unsafeIRDirty_0_N(  2
+                           , "BF_(doLoad)"
+                           , VG_(fnptr_to_fnentry)(&BF_(doLoad))
+                           , mkIRExprVec_2(addr, bytes) );
+  }
+
+  di->guard = IRExpr_RdTmp(any);
+
+  addStmtToIRSB(bb, IRStmt_Dirty(di));
+}
+
+
+/**
+ * Adds BF_(addAccessCheck) calls for every guest memory access made by
+ * statement, ahead of it.  Reads are checked as loads, so a
+ * read-modify-write (CAS, or a dirty helper that modifies memory)
+ * activates the SEUs it touches.
+ */
+static void
+BF_(addAccessChecks) (IRSB* bb, IRStmt* statement)
+{
+  IRTypeEnv* env = bb->tyenv;
+  IRType     wide;
+  IRType     narrow;
+  Int        size;
+
+
+  switch (statement->tag)
+  {
+    case Ist_WrTmp:
+      if (statement->Ist.WrTmp.data->tag == Iex_Load)
+      {
+        IRExpr* load = statement->Ist.WrTmp.data;
+        BF_(addAccessCheck)(bb, load->Iex.Load.addr,
+                            sizeofIRType(load->Iex.Load.ty), 0, False);
+      }
+      break;
+
+    case Ist_Store:
+      size = sizeofIRType(typeOfIRExpr(env, statement->Ist.Store.data));
+      BF_(addAccessCheck)(bb, statement->Ist.Store.addr, size, 0, True);
+      break;
+
+    case Ist_LoadG:
+    {
+      IRLoadG* lg = statement->Ist.LoadG.details;
+      typeOfIRLoadGOp(lg->cvt, &wide, &narrow);
+      BF_(addAccessCheck)(bb, lg->addr, sizeofIRType(narrow), lg->guard,
+                          False);
+      break;
+    }
+
+    case Ist_StoreG:
+    {
+      IRStoreG* sg = statement->Ist.StoreG.details;
+      size = sizeofIRType(typeOfIRExpr(env, sg->data));
+      BF_(addAccessCheck)(bb, sg->addr, size, sg->guard, True);
+      break;
+    }
+
+    case Ist_CAS:
+    {
+      IRCAS* cas = statement->Ist.CAS.details;
+      size = sizeofIRType(typeOfIRExpr(env, cas->dataLo));
+      if (cas->dataHi != 0) size *= 2;
+      BF_(addAccessCheck)(bb, cas->addr, size, 0, False);
+      break;
+    }
+
+    case Ist_LLSC:
+      if (statement->Ist.LLSC.storedata == 0)
+      {
+        size = sizeofIRType(typeOfIRTemp(env, statement->Ist.LLSC.result));
+        BF_(addAccessCheck)(bb, statement->Ist.LLSC.addr, size, 0, False);
+      }
+      else
+      {
+        size = sizeofIRType(typeOfIRExpr(env, statement->Ist.LLSC.storedata));
+        BF_(addAccessCheck)(bb, statement->Ist.LLSC.addr, size, 0, True);
+      }
+      break;
+
+    case Ist_Dirty:
+    {
+      IRDirty* d = statement->Ist.Dirty.details;
+      if (d->mFx != Ifx_None)
+      {
+        BF_(addAccessCheck)(bb, d->mAddr, d->mSize, d->guard,
+                            d->mFx == Ifx_Write);
+      }
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+
+/**
+ * @return True if name matches any of patterns.
+ */
+static Bool
+BF_(matchPatterns) (const VgBF_Patterns_t* patterns, const HChar* name)
+{
+  UInt i;
+
+
+  for (i = 0; i < patterns->n; ++i)
+  {
+    if ( VG_(string_match)(patterns->pattern[i], name) ) return True;
+  }
+
+  return False;
+}
+
+
+/**
+ * @return True if the code at addr is selected for fault checks by
+ * --inject-in-fn, --inject-in-obj and --exclude-obj.  Code with no
+ * debug info has the empty string as its function and object names.
+ */
+static Bool
+BF_(isSelected) (Addr addr)
+{
+  DiEpoch      ep  = VG_(current_DiEpoch)();
+  const HChar* obj = "";
+  const HChar* fn  = "";
+
+
+  if (InjectFns.n == 0 && InjectObjs.n == 0 && ExcludeObjs.n == 0)
+  {
+    return True;
+  }
+
+  if ( !VG_(get_objname)(ep, addr, &obj) ) obj = "";
+
+  if (BF_(matchPatterns)(&ExcludeObjs, obj)) return False;
+
+  if (InjectObjs.n > 0 && !BF_(matchPatterns)(&InjectObjs, obj))
+  {
+    return False;
+  }
+
+  if (InjectFns.n > 0)
+  {
+    if ( !VG_(get_fnname)(ep, addr, &fn) ) fn = "";
+    if ( !BF_(matchPatterns)(&InjectFns, fn) ) return False;
+  }
+
+  return True;
+}
+
+
+/**
+ * Main instrumentation function
+ */
+static IRSB*
+BF_(instrument) (  VgCallbackClosure* closure
+                 , IRSB*              bbIn
+                 , const VexGuestLayout*    layout
+                 , const VexGuestExtents*   vge
+                 , const VexArchInfo*       archinfo_host
+                 , IRType             gWordTy
+                 , IRType             hWordTy )
+{
+  Int   n;
+  Bool  counted;
+  Bool  check   = True;
+  Bool  bulk    = False;
+  UInt  pending = 0;
+  IRSB* bbOut;
+
+
+  if (Idle) return bbIn;
+
+  // Superblocks are selected as a whole by the address of their first
+  // instruction.  Lazy SEUs activate on access anywhere, so unselected
+  // superblocks still need their access checks.
+  if ( !BF_(isSelected)(vge->base[0]) )
+  {
+    if (OutsideTime == BF_OUTSIDE_STOP)
+    {
+      if (InjectMode != BF_INJECT_LAZY) return bbIn;
+      check = False;
+    }
+
+    bulk = True;
+  }
+
+  bbOut            = emptyIRSB();
+  bbOut->tyenv     = deepCopyIRTypeEnv(bbIn->tyenv);
+  bbOut->next      = deepCopyIRExpr(bbIn->next);
+  bbOut->jumpkind  = bbIn->jumpkind;
+  bbOut->offsIP    = bbIn->offsIP;
+  
+
+  for (n = 0; n < bbIn->stmts_used; ++n)
+  {
+    IRStmt* statement = bbIn->stmts[n];
+
+    if (!statement || statement->tag == Ist_NoOp) continue;
+
+    counted = check &&
+              ((RateUnit == BF_UNIT_STMT) || (statement->tag == Ist_IMark));
+
+    if (FaultCheck == BF_CHECK_SUPERBLOCK || bulk)
+    {
+      if (counted) ++pending;
+
+      if (statement->tag == Ist_Exit && pending > 0)
+      {
+        BF_(addFaultCheckN)(bbOut, pending);
+        pending = 0;
+      }
+    }
+    else if (counted)
+    {
+      BF_(addFaultCheck)(bbOut);
+    }
+
+    if (counted && RegisterFaultRate > 0)
+    {
+      BF_(addRegisterCheck)(bbOut, pending);
+    }
+
+    if (InjectMode == BF_INJECT_LAZY)
+    {
+      BF_(addAccessChecks)(bbOut, statement);
+    }
+
+    addStmtToIRSB(bbOut, statement);
+  }
+
+  if (pending > 0)
+  {
+    BF_(addFaultCheckN)(bbOut, pending);
+  }
+
+  return bbOut;
+}
+
+
+
+/*------------------------------------------------------------*/
+/*--- Handle client requests                                --*/
+/*------------------------------------------------------------*/
+
+
+/**
+ * Starts forked run number index (0-based) in a child of
+ * BF_(forkRuns)(): reseeds the random number generator with
+ * RandomSeed + index and, with --trace-file, opens a fresh trace
+ * named "<file>.<index>" that describes blocks anew.
+ */
+static void
+BF_(startForkRun) (UInt index)
+{
+  VgBF_MemBlock_t* block;
+  Int              g;
+
+
+  RandomSeed += index;
+  BF_(Random_seed)(RngKind, RandomSeed);
+
+  VG_(message)(Vg_UserMsg, "fork-run: %u of %u, seed %u\n",
+               index + 1, ForkRuns, RandomSeed);
+
+  if (TraceFile != 0)
+  {
+    HChar* base = VG_(expand_file_name)("--trace-file", TraceFile);
+    HChar* path = VG_(malloc)("bf.trace", VG_(strlen)(base) + 16);
+
+    VG_(sprintf)(path, "%s.%u", base, index);
+
+    VG_(OSetGen_ResetIter)(MemBlocks);
+    while ( (block = VG_(OSetGen_Next)(MemBlocks)) != 0 )
+    {
+      block->traced = False;
+    }
+
+    // The register pseudo-blocks are not in MemBlocks
+    for (g = 0; g < BF_REG_GROUPS; ++g)
+    {
+      RegGroups[g].block.traced = False;
+    }
+
+    if (!BF_(Trace_open)(path, RandomSeed, FaultRate))
+    {
+      VG_(message)(Vg_UserMsg, "BITFLIPS: cannot create trace file '%s'\n",
+                   path);
+    }
+
+    VG_(free)(path);
+    VG_(free)(base);
+  }
+}
+
+
+/**
+ * Implements --fork-runs.  At the first VALGRIND_BITFLIPS_ON, the
+ * fault-free prefix of the program has already run once; fork ForkRuns
+ * children from this point, ForkJobs at a time, each of which returns
+ * from here and runs the rest of the program as an independent run
+ * with its own seed.  The parent never returns: it waits for all of
+ * the children, reports each run that exited non-zero or was killed (as
+ * SEUs are expected to make some do) and exits, failing only if a run
+ * could not be started.
+ *
+ * The children are plain fork()s of the Valgrind process, so this is
+ * only sound for single-threaded programs.  Only the children's own
+ * pids are waited for, oldest first, so that children the program
+ * forked itself during the prefix are left alone.  The parent's trace
+ * (if any) is closed at the fork and covers only the prefix.
+ */
+static void
+BF_(forkRuns) (void)
+{
+  Int*  pids    = VG_(malloc)("bf.fork", ForkJobs * sizeof(Int));
+  UInt* runs    = VG_(malloc)("bf.fork", ForkJobs * sizeof(UInt));
+  UInt  started = 0;
+  UInt  running = 0;
+  UInt  oldest  = 0;
+  UInt  crashed = 0;
+  UInt  failed  = 0;
+  UInt  slot;
+  Int   status;
+  Int   pid;
+
+
+  Forked = True;
+
+  BF_(Trace_close)(FaultCount, InstructionCount, KilobyteFlux);
+
+  while (started < ForkRuns || running > 0)
+  {
+    if (started < ForkRuns && running < ForkJobs)
+    {
+      pid = VG_(fork)();
+
+      if (pid == 0)
+      {
+        VG_(free)(pids);
+        VG_(free)(runs);
+        BF_(startForkRun)(started);
+        return;
+      }
+
+      if (pid < 0)
+      {
+        VG_(message)(Vg_UserMsg, "BITFLIPS: fork failed after %u runs\n",
+                     started);
+        failed  += ForkRuns - started;
+        ForkRuns = started;
+        continue;
+      }
+
+      slot       = (oldest + running) % ForkJobs;
+      pids[slot] = pid;
+      runs[slot] = started;
+
+      started++;
+      running++;
+    }
+    else
+    {
+      if (VG_(waitpid)(pids[oldest], &status, 0) < 0)
+      {
+        VG_(message)(Vg_UserMsg, "BITFLIPS: lost fork-run %u\n",
+                     runs[oldest] + 1);
+        failed++;
+      }
+      else if (status != 0)
+      {
+        // The Linux wait status: a signal number, or an exit code << 8
+        if ((status & 0x7f) != 0)
+        {
+          VG_(message)(Vg_UserMsg, "fork-run: %u (seed %u) killed by "
+                       "signal %d\n", runs[oldest] + 1,
+                       RandomSeed + runs[oldest], status & 0x7f);
+        }
+        else
+        {
+          VG_(message)(Vg_UserMsg, "fork-run: %u (seed %u) exited with "
+                       "status %d\n", runs[oldest] + 1,
+                       RandomSeed + runs[oldest], (status >> 8) & 0xff);
+        }
+        crashed++;
+      }
+
+      oldest = (oldest + 1) % ForkJobs;
+      running--;
+    }
+  }
+
+  VG_(message)(Vg_UserMsg, "fork-runs: %u runs, %u exited non-zero or "
+               "were killed, %u lost to fork or wait errors\n",
+               started, crashed, failed);
+
+  VG_(free)(pids);
+  VG_(free)(runs);
+
+  VG_(exit)(failed > 0 ? 1 : 0);
+}
+
+
+static Bool
+BF_(handle_client_request) (ThreadId tid, UWord* arg, UWord *ret)
+{
+  if (!VG_IS_TOOL_USERREQ('B','F', arg[0]))
+  {
+    return False;
+  }
+
+  switch(arg[0])
+  {
+    case VG_USERREQ__BITFLIPS_ON:
+      if (Verbose)
+      {
+        VG_(message)(Vg_UserMsg, "VALGRIND_BITFLIPS_ON\n");
+      }
+      if (ForkRuns > 0 && !Forked)
+      {
+        BF_(forkRuns)();
+      }
+      FaultInjection = True;
+      BF_(reschedule)();
+      *ret           = 0;
+      break;
+
+    case VG_USERREQ__BITFLIPS_OFF:
+      if (Verbose)
       {
-        Int size = sizeofIRType(data->Iex.Load.ty);
-        BF_(addLoadCheck)(bbOut, data->Iex.Load.addr, size);
+        VG_(message)(Vg_UserMsg, "VALGRIND_BITFLIPS_OFF\n");
       }
+      FaultInjection = False;
+      BF_(reschedule)();
+      *ret           = 0;
+      break;
+
+  case VG_USERREQ__BITFLIPS_MEM_ON:
+    if (Verbose)
+    {
+      VG_(message)(Vg_UserMsg, "VALGRIND_BITFLIPS_MEM_ON:  %s\n", (char*)arg[4]);
+    }
+    *ret = BF_(MemOn)( arg[1], arg[2], arg[3]
+                     , arg[5] & (BITFLIPS_ROW_MAJOR - 1)
+                     , arg[5] & (BITFLIPS_ROW_MAJOR + BITFLIPS_COL_MAJOR)
+                     , (HChar*) arg[4]
+                     , VG_(record_ExeContext)(tid, 0)
+                     , BF_ORIGIN_USER ) ? 0 : 1;
+    BF_(reschedule)();
+    break;
+
+  case VG_USERREQ__BITFLIPS_MEM_OFF:
+    if (Verbose)
+    {
+      VG_(message)(Vg_UserMsg, "VALGRIND_BITFLIPS_MEM_OFF: %s\n", (char*)arg[4]);
+    }
+    BF_(MemOffRequest)(arg[1]);
+    BF_(reschedule)();
+    *ret = 0;
+    break;
+
+  case VG_USERREQ__BITFLIPS_MEM_ON_BATCH:
+    *ret = BF_(MemOnBatch)(tid, (VgBF_MemDesc_t*) arg[1], arg[2]);
+    BF_(reschedule)();
+    break;
+
+  case VG_USERREQ__BITFLIPS_MEM_OFF_BATCH:
+    BF_(MemOffBatch)((VgBF_MemDesc_t*) arg[1], arg[2]);
+    BF_(reschedule)();
+    *ret = 0;
+    break;
+
+    default:
+      return False;
+  }
+
+  return True;
+}
+
+
+
+/*------------------------------------------------------------*/
+/*--- Heap replacement (--expose-heap)                      --*/
+/*------------------------------------------------------------*/
+
+
+/**
+ * Registers the n-byte heap block at p, as a column of bytes, if
+ * --expose-heap is on, unless it is empty or lies in memory already
+ * registered by a client request.  While FaultInjection is off the
+ * exposure does not change, so the reschedule is left to
+ * VALGRIND_BITFLIPS_ON.
+ */
+static void
+BF_(HeapOn) (void* p, SizeT n)
+{
+  Addr start = (Addr) p;
+
+
+  if (!ExposeHeap || p == 0 || n == 0) return;
+
+  if (BF_(MemBlock_findOverlap)(start, start + n - 1) != 0) return;
+
+  BF_(MemOn)(  start, n, 1, BITFLIPS_UCHAR, BITFLIPS_ROW_MAJOR
+             , "(heap)", 0, BF_ORIGIN_HEAP );
+
+  ++HeapBlocks;
+
+  if (FaultInjection) BF_(reschedule)();
+}
+
+
+/**
+ * Deregisters the heap block at p, which is being freed, if it was
+ * registered by BF_(HeapOn)(), or forgets it if it is shadowed.
+ */
+static void
+BF_(HeapOff) (void* p)
+{
+  Addr             start = (Addr) p;
+  VgBF_MemBlock_t* block;
+
+
+  if (!ExposeHeap || p == 0) return;
+
+  block = VG_(OSetGen_Lookup)(MemBlocks, &start);
+
+  if (block != 0 && block->origin == BF_ORIGIN_HEAP)
+  {
+    BF_(MemOff)(start);
+
+    if (FaultInjection) BF_(reschedule)();
+  }
+  else
+  {
+    BF_(unshadow)(start, start, BF_ORIGIN_HEAP);
+  }
+}
+
+
+static void*
+BF_(alloc) (SizeT align, SizeT n)
+{
+  void* p = VG_(cli_malloc)(align, n);
+
+
+  BF_(HeapOn)(p, n);
+
+  return p;
+}
+
+
+static void*
+BF_(malloc) (ThreadId tid, SizeT n)
+{
+  return BF_(alloc)(VG_(clo_alignment), n);
+}
+
+
+static void*
+BF_(__builtin_new) (ThreadId tid, SizeT n)
+{
+  return BF_(alloc)(VG_(clo_alignment), n);
+}
+
+
+static void*
+BF_(__builtin_vec_new) (ThreadId tid, SizeT n)
+{
+  return BF_(alloc)(VG_(clo_alignment), n);
+}
+
+
+static void*
+BF_(memalign) (ThreadId tid, SizeT align, SizeT n)
+{
+  return BF_(alloc)(align, n);
+}
+
+
+static void*
+BF_(calloc) (ThreadId tid, SizeT nmemb, SizeT size1)
+{
+  void* p;
+
+
+  if (nmemb != 0 && size1 > ~(SizeT) 0 / nmemb) return 0;
+
+  p = VG_(cli_malloc)(VG_(clo_alignment), nmemb * size1);
+
+  if (p != 0)
+  {
+    VG_(memset)(p, 0, nmemb * size1);
+    BF_(HeapOn)(p, nmemb * size1);
+  }
+
+  return p;
+}
+
+
+static void
+BF_(free) (ThreadId tid, void* p)
+{
+  BF_(HeapOff)(p);
+  VG_(cli_free)(p);
+}
+
+
+static void
+BF_(__builtin_delete) (ThreadId tid, void* p)
+{
+  BF_(free)(tid, p);
+}
+
+
+static void
+BF_(__builtin_vec_delete) (ThreadId tid, void* p)
+{
+  BF_(free)(tid, p);
+}
+
+
+/**
+ * Moves the heap block at p to a new n-byte block.  The copy reads the
+ * old block, so SEUs pending in it under BF_INJECT_LAZY are applied
+ * first.
+ */
+static void*
+BF_(realloc) (ThreadId tid, void* p, SizeT n)
+{
+  SizeT copy;
+  void* q;
+
+
+  if (p == 0) return BF_(malloc)(tid, n);
+
+  copy = VG_(cli_malloc_usable_size)(p);
+  q    = VG_(cli_malloc)(VG_(clo_alignment), n);
+
+  if (q == 0) return 0;
+
+  if (copy > n) copy = n;
+
+  if (PendingCount != 0) BF_(doLoad)((Addr) p, copy);
+
+  VG_(memcpy)(q, p, copy);
+  BF_(free)(tid, p);
+  BF_(HeapOn)(q, n);
+
+  return q;
+}
+
+
+static SizeT
+BF_(malloc_usable_size) (ThreadId tid, void* p)
+{
+  return VG_(cli_malloc_usable_size)(p);
+}
+
+
+
+/*------------------------------------------------------------*/
+/*--- Globals and stacks (--expose-globals, --expose-stack) --*/
+/*------------------------------------------------------------*/
+
+
+/**
+ * Registers, as columns of bytes, the global variables matching
+ * --expose-globals in the object whose debug info was just loaded as
+ * di_handle, at their DWARF sizes.  Valgrind truncates variable names
+ * to 15 characters, so the patterns match the truncated name.  Only
+ * variables in .data and .bss are registered: const globals live in
+ * read-only memory, which an SEU must not be written to.  ww describes
+ * only the mapping that completed the debug info, not the one holding
+ * each variable, and a .bss may not be mapped yet, so the variable's
+ * section is checked instead.  Called for the objects mapped at startup
+ * and for every later mmap (e.g. dlopen).
+ */
+static void
+BF_(newGlobals) (  Addr  a
+                 , SizeT len
+                 , Bool  rr
+                 , Bool  ww
+                 , Bool  xx
+                 , ULong di_handle )
+{
+  XArray* blocks;
+  Word    i;
+
+
+  if (di_handle == 0) return;
+
+  blocks = VG_(di_get_global_blocks_from_dihandle)(di_handle, False);
+
+  for (i = 0; i < VG_(sizeXA)(blocks); ++i)
+  {
+    GlobalBlock* g   = VG_(indexXA)(blocks, i);
+    Addr         end = g->addr + g->szB - 1;
+    VgSectKind   kind;
+
+    if (g->szB == 0) continue;
+    if ( !BF_(matchPatterns)(&ExposeGlobals, g->name) ) continue;
+
+    kind = VG_(DebugInfo_sect_kind)(NULL, g->addr);
+    if (kind != Vg_SectData && kind != Vg_SectBSS) continue;
+    if ( BF_(MemBlock_findOverlap)(g->addr, end) != 0 ) continue;
+
+    BF_(MemOn)(  g->addr, g->szB, 1, BITFLIPS_UCHAR, BITFLIPS_ROW_MAJOR
+               , g->name, 0, BF_ORIGIN_GLOBAL );
+
+    ++GlobalBlocks;
+
+    if (Verbose)
+    {
+      VG_(message)(Vg_UserMsg, "expose-globals: %s [%#lx, %#lx]\n",
+                   g->name, g->addr, end);
+    }
+  }
+
+  VG_(deleteXA)(blocks);
+
+  if (FaultInjection) BF_(reschedule)();
+}
+
+
+/**
+ * Deregisters the global and stack blocks in the len bytes at a, which
+ * are being unmapped, and forgets the shadowed globals there.
+ */
+static void
+BF_(dieMapping) (Addr a, SizeT len)
+{
+  VgBF_MemBlock_t* block;
+  Addr             from    = a;
+  Bool             changed = False;
+
+
+  while (True)
+  {
+    VG_(OSetGen_ResetIterAt)(MemBlocks, &from);
+    block = VG_(OSetGen_Next)(MemBlocks);
+
+    if (block == 0 || block->start >= a + len) break;
+
+    from = block->start + 1;
+
+    if (block->origin == BF_ORIGIN_GLOBAL || block->origin == BF_ORIGIN_STACK)
+    {
+      BF_(MemOff)(block->start);
+      changed = True;
     }
-    */
+  }
+
+  BF_(unshadow)(a, a + len - 1, BF_ORIGIN_GLOBAL);
+
+  if (changed && FaultInjection) BF_(reschedule)();
+}
+
+
+/**
+ * Extends the running thread's stack block down to a, the new stack
+ * pointer, if that is below its lowest point so far.  The block covers
+ * every byte the stack has reached, up to the thread's stack top: dead
+ * frames are still memory, and SEUs in them are simply overwritten.
+ * Stacks[tid] is the start of the block, or 0 if there is none,
+ * e.g. because a VALGRIND_BITFLIPS_MEM_ON region on the stack took
+ * precedence.  A stack pointer outside the thread's stack, on a
+ * coroutine or signal stack that Valgrind did not recognise as a
+ * switch (see --max-stackframe), is ignored.
+ */
+static void
+BF_(newStack) (Addr a, SizeT len)
+{
+  ThreadId         tid   = VG_(get_running_tid)();
+  Addr             top   = VG_(thread_get_stack_max)(tid);
+  Addr             min   = top - VG_(thread_get_stack_size)(tid) + 1;
+  Addr             low   = Stacks[tid];
+  SizeT            bytes = top - a + 1;
+  VgBF_MemBlock_t* block = 0;
+
+
+  if ((low != 0 && a >= low) || a > top || a < min) return;
+
+  if (low != 0) block = VG_(OSetGen_Lookup)(MemBlocks, &low);
+
+  if (block != 0 && block->origin == BF_ORIGIN_STACK)
+  {
+    if ( BF_(MemBlock_findOverlap)(a, low - 1) != 0 ) return;
+
+    // Rows are byte offsets from the start, which moves, so the block
+    // is described anew in a trace
+    VG_(OSetGen_Remove)(MemBlocks, &low);
+
+    block->start         = a;
+    block->end           = top;
+    block->num_rows      = bytes;
+    block->num_elems     = bytes;
+    block->num_bytes     = bytes;
+    block->num_kilobytes = bytes / 1000.0;
+    block->id            = NextBlockId++;
+    block->traced        = False;
+
+    BF_(Exposure_resize)(&Exposure, block->slot, bytes);
+    VG_(OSetGen_Insert)(MemBlocks, block);
+  }
+  else
+  {
+    Stacks[tid] = 0;
 
-    addStmtToIRSB(bbOut, statement);
+    if ( BF_(MemBlock_findOverlap)(a, top) != 0 ) return;
+
+    BF_(MemOn)(  a, bytes, 1, BITFLIPS_UCHAR, BITFLIPS_ROW_MAJOR
+               , "(stack)", 0, BF_ORIGIN_STACK );
   }
 
-  return bbOut;
+  Stacks[tid] = a;
+
+  if (FaultInjection) BF_(reschedule)();
+}
+
+
+/**
+ * Deregisters the stack block of thread tid, which is exiting, so that
+ * neither the block nor Stacks[tid] outlives the thread.
+ */
+static void
+BF_(dieThread) (ThreadId tid)
+{
+  Addr             low   = Stacks[tid];
+  VgBF_MemBlock_t* block = 0;
+
+
+  if (low == 0) return;
+
+  Stacks[tid] = 0;
+  block       = VG_(OSetGen_Lookup)(MemBlocks, &low);
+
+  if (block == 0 || block->origin != BF_ORIGIN_STACK) return;
+
+  BF_(MemOff)(low);
+
+  if (FaultInjection) BF_(reschedule)();
 }
 
 
 
 /*------------------------------------------------------------*/
-/*--- Handle client requests                                --*/
+/*-- Command-line, usage, initialization, finalization        */
 /*------------------------------------------------------------*/
 
 
+/**
+ * Parses a bit-flip multiplicity distribution spec into weights, where
+ * weights[b] (b <= max) is the relative frequency of SEUs that flip b
+ * bits.  The spec is a list of "<bits>:<weight>" pairs separated by
+ * commas or whitespace; the colon may also be whitespace, so a file with
+ * one "<bits> <weight>" pair per line works too.  '#' starts a comment.
+ *
+ * @return True if spec is well-formed with at least one positive weight.
+ */
 static Bool
-BF_(handle_client_request) (ThreadId tid, UWord* arg, UWord *ret)
+BF_(parseFlipDensity) (const HChar* spec, double* weights, UInt max)
 {
-  if (!VG_IS_TOOL_USERREQ('B','F', arg[0]))
+  const HChar* p     = spec;
+  HChar*       end;
+  Long         bits;
+  double       weight;
+  double       total = 0.0;
+
+
+  VG_(memset)(weights, 0, (max + 1) * sizeof(double));
+
+  while (1)
   {
-    return False;
+    while (*p == ',' || *p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+    {
+      ++p;
+    }
+
+    if (*p == '#')
+    {
+      while (*p != '\0' && *p != '\n') ++p;
+      continue;
+    }
+
+    if (*p == '\0') break;
+
+    bits = VG_(strtoll10)(p, &end);
+    if (end == p || bits < 1 || bits > max) return False;
+    p = end;
+
+    while (*p == ' ' || *p == '\t') ++p;
+    if (*p == ':') ++p;
+
+    weight = VG_(strtod)(p, &end);
+    if (end == p || !(weight >= 0)) return False;
+    p = end;
+
+    weights[bits] += weight;
+    total         += weight;
   }
 
-  switch(arg[0])
+  return total > 0;
+}
+
+
+/**
+ * @return the per-instruction rate given by spec for option, a
+ * non-negative number with an optional exponent and SI prefix followed
+ * by an optional unit: "/insn" (the default) or "/s", which is
+ * converted with insn_rate instructions per second.
+ */
+static double
+BF_(parseRate) (const HChar* option, const HChar* spec, double insn_rate)
+{
+  const HChar* unit;
+  double       rate = BF_(Value_parse)(spec, &unit);
+
+
+  if (unit == spec || !(rate >= 0) || !BF_(Value_isFinite)(rate))
   {
-    case VG_USERREQ__BITFLIPS_ON:
-      if (Verbose)
-      {
-        VG_(message)(Vg_UserMsg, "VALGRIND_BITFLIPS_ON\n");
-      }
-      FaultInjection = True;
-      *ret           = 0;
-      break;
+    VG_(fmsg_bad_option)(option,
+                         "'%s' is not a non-negative number\n", spec);
+  }
 
-    case VG_USERREQ__BITFLIPS_OFF:
-      if (Verbose)
-      {
-        VG_(message)(Vg_UserMsg, "VALGRIND_BITFLIPS_OFF\n");
-      }
-      FaultInjection = False;
-      *ret           = 0;
-      break;
+  if (*unit == '\0' || 0 == VG_(strcmp)(unit, "/insn"))
+  {
+    return rate;
+  }
+  else if (0 == VG_(strcmp)(unit, "/s"))
+  {
+    return rate / insn_rate;
+  }
 
-  case VG_USERREQ__BITFLIPS_MEM_ON:
-    if (Verbose)
+  VG_(fmsg_bad_option)(option,
+                       "unknown unit '%s' (expected /insn or /s)\n", unit);
+  return 0;
+}
+
+
+/**
+ * Sets FaultRate (SEUs / (KB * instruction)) from --fault-rate and
+ * RegisterFaultRate (SEUs / (bit * instruction)) from
+ * --register-fault-rate (see BF_(parseRate)).
+ */
+static void
+BF_(initFaultRate) (void)
+{
+  const HChar* end;
+  double       insn_rate = BF_(Value_parse)(InsnRateSpec, &end);
+
+
+  if (*end != '\0' || end == InsnRateSpec ||
+      !(insn_rate > 0) || !BF_(Value_isFinite)(insn_rate))
+  {
+    VG_(fmsg_bad_option)("--insn-rate",
+                         "'%s' is not a positive number\n", InsnRateSpec);
+  }
+
+  FaultRate         = BF_(parseRate)("--fault-rate", FaultRateSpec,
+                                     insn_rate);
+  RegisterFaultRate = BF_(parseRate)("--register-fault-rate",
+                                     RegisterFaultRateSpec, insn_rate);
+}
+
+
+/**
+ * @return the contents of the file at path as a NUL-terminated string
+ * (to be freed with VG_(free)) or null (0) if it cannot be read.
+ */
+static HChar*
+BF_(readFile) (const HChar* path)
+{
+  SysRes res  = VG_(open)(path, VKI_O_RDONLY, 0);
+  Int    fd;
+  Int    n;
+  SizeT  size = 0;
+  SizeT  room = 4096;
+  HChar* buf;
+
+
+  if (sr_isError(res)) return 0;
+
+  fd  = sr_Res(res);
+  buf = VG_(malloc)("bf.readFile", room);
+
+  while ((n = VG_(read)(fd, buf + size, room - size - 1)) > 0)
+  {
+    size += n;
+
+    if (room - size - 1 == 0)
     {
-      VG_(message)(Vg_UserMsg, "VALGRIND_BITFLIPS_MEM_ON:  %s\n", (char*)arg[4]);
+      room *= 2;
+      buf   = VG_(realloc)("bf.readFile", buf, room);
     }
-    BF_(MemOn)(tid, arg);
-    *ret = 0;
-    break;
+  }
 
-  case VG_USERREQ__BITFLIPS_MEM_OFF:
-    if (Verbose)
+  VG_(close)(fd);
+
+  if (n < 0)
+  {
+    VG_(free)(buf);
+    return 0;
+  }
+
+  buf[size] = '\0';
+  return buf;
+}
+
+
+/**
+ * Builds the FlipDensity alias table from --flip-density-file, if
+ * given, or --flip-density.
+ */
+static void
+BF_(initFlipDensity) (void)
+{
+  double weights[BF_MAX_FLIP_BITS + 1];
+  UInt   values [BF_MAX_FLIP_BITS];
+  double nonzero[BF_MAX_FLIP_BITS];
+  UInt   bits;
+  UInt   n = 0;
+
+
+  if (FlipDensityFile != 0)
+  {
+    HChar* contents = BF_(readFile)(FlipDensityFile);
+
+    if (contents == 0)
     {
-      VG_(message)(Vg_UserMsg, "VALGRIND_BITFLIPS_MEM_OFF: %s\n", (char*)arg[4]);
+      VG_(fmsg_bad_option)("--flip-density-file",
+                           "cannot read '%s'\n", FlipDensityFile);
     }
-    BF_(MemOff)(arg);
-    *ret = 0;
-    break;
 
-    default:
-      return False;
+    if (!BF_(parseFlipDensity)(contents, weights, BF_MAX_FLIP_BITS))
+    {
+      VG_(fmsg_bad_option)("--flip-density-file",
+                           "'%s' is not a valid distribution\n",
+                           FlipDensityFile);
+    }
+
+    VG_(free)(contents);
+  }
+  else if (!BF_(parseFlipDensity)(FlipDensitySpec, weights,
+                                  BF_MAX_FLIP_BITS))
+  {
+    VG_(fmsg_bad_option)("--flip-density",
+                         "'%s' is not a valid distribution\n",
+                         FlipDensitySpec);
   }
 
-  return True;
+  for (bits = 1; bits <= BF_MAX_FLIP_BITS; ++bits)
+  {
+    if (weights[bits] > 0)
+    {
+      values [n] = bits;
+      nonzero[n] = weights[bits];
+      ++n;
+    }
+  }
+
+  BF_(Alias_init)(&FlipDensity, values, nonzero, n);
 }
 
 
+/**
+ * Builds the McuDensity alias table of cluster lengths from
+ * --mcu-density, if given.
+ */
+static void
+BF_(initMcuDensity) (void)
+{
+  double weights[BF_MAX_MCU_BITS + 1];
+  UInt   values [BF_MAX_MCU_BITS];
+  double nonzero[BF_MAX_MCU_BITS];
+  UInt   bits;
+  UInt   n = 0;
 
-/*------------------------------------------------------------*/
-/*-- Command-line, usage, initialization, finalization        */
-/*------------------------------------------------------------*/
+
+  if (McuDensitySpec == 0) return;
+
+  if (!BF_(parseFlipDensity)(McuDensitySpec, weights, BF_MAX_MCU_BITS))
+  {
+    VG_(fmsg_bad_option)("--mcu-density",
+                         "'%s' is not a valid distribution\n",
+                         McuDensitySpec);
+  }
+
+  for (bits = 1; bits <= BF_MAX_MCU_BITS; ++bits)
+  {
+    if (weights[bits] > 0)
+    {
+      values [n] = bits;
+      nonzero[n] = weights[bits];
+      ++n;
+    }
+  }
+
+  BF_(Alias_init)(&McuDensity, values, nonzero, n);
+}
+
+
+/**
+ * Appends pattern to patterns, given by option.
+ */
+static void
+BF_(addPattern) (VgBF_Patterns_t* patterns, const HChar* option,
+                 const HChar* pattern)
+{
+  if (patterns->n == BF_MAX_PATTERNS)
+  {
+    VG_(fmsg_bad_option)(option, "at most %d patterns are allowed\n",
+                         BF_MAX_PATTERNS);
+  }
+
+  patterns->pattern[ patterns->n++ ] = pattern;
+}
 
 
 static Bool
 BF_(command_line_options) (const HChar* arg)
 {
-  UInt  rate = 0;
+  const HChar* pattern;
 
 
-  if      VG_INT_CLO (arg, "--fault-rate"   , rate           ) {}
+  if      VG_STR_CLO (arg, "--fault-rate"   , FaultRateSpec  ) {}
+  else if VG_STR_CLO (arg, "--insn-rate"    , InsnRateSpec   ) {}
   else if VG_BOOL_CLO(arg, "--inject-faults", FaultInjection ) {}
-  else if VG_INT_CLO (arg, "--seed"         , RandomState    ) {}
+  else if VG_INT_CLO (arg, "--seed"         , RandomSeed     ) {}
   else if VG_BOOL_CLO(arg, "--verbose"      , Verbose        ) {}
-  else {
-    return False;
+  else if VG_XACT_CLO(arg, "--fault-schedule=poisson",
+                      FaultSchedule, BF_SCHEDULE_POISSON) {}
+  else if VG_XACT_CLO(arg, "--fault-schedule=skip",
+                      FaultSchedule, BF_SCHEDULE_SKIP) {}
+  else if VG_XACT_CLO(arg, "--fault-check=helper",
+                      FaultCheck, BF_CHECK_HELPER) {}
+  else if VG_XACT_CLO(arg, "--fault-check=inline",
+                      FaultCheck, BF_CHECK_INLINE) {}
+  else if VG_XACT_CLO(arg, "--fault-check=superblock",
+                      FaultCheck, BF_CHECK_SUPERBLOCK) {}
+  else if VG_XACT_CLO(arg, "--rate-unit=stmt", RateUnit, BF_UNIT_STMT) {}
+  else if VG_XACT_CLO(arg, "--rate-unit=insn", RateUnit, BF_UNIT_INSN) {}
+  else if VG_XACT_CLO(arg, "--rng=lcg"      , RngKind, BF_RNG_LCG    ) {}
+  else if VG_XACT_CLO(arg, "--rng=xoshiro"  , RngKind, BF_RNG_XOSHIRO) {}
+  else if VG_STR_CLO (arg, "--flip-density" , FlipDensitySpec) {}
+  else if VG_STR_CLO (arg, "--flip-density-file", FlipDensityFile) {}
+  else if VG_STR_CLO (arg, "--trace-file"   , TraceFile      ) {}
+  else if VG_BOOL_CLO(arg, "--skip-idle"    , SkipIdle       ) {}
+  else if VG_STR_CLO (arg, "--inject-in-fn" , pattern) {
+    BF_(addPattern)(&InjectFns, "--inject-in-fn", pattern);
   }
-
-  if (0 == VG_(strncmp)(arg, "--fault-rate", 12))
-  {
-    UInt* p = (UInt*) &FaultRate;
-    VG_(memcpy)(p, &rate, 4);
+  else if VG_STR_CLO (arg, "--inject-in-obj", pattern) {
+    BF_(addPattern)(&InjectObjs, "--inject-in-obj", pattern);
+  }
+  else if VG_STR_CLO (arg, "--exclude-obj"  , pattern) {
+    BF_(addPattern)(&ExcludeObjs, "--exclude-obj", pattern);
+  }
+  else if VG_XACT_CLO(arg, "--outside-time=stop", OutsideTime, BF_OUTSIDE_STOP) {}
+  else if VG_XACT_CLO(arg, "--outside-time=bulk", OutsideTime, BF_OUTSIDE_BULK) {}
+  else if VG_BINT_CLO(arg, "--fork-runs"    , ForkRuns, 0, 1000000) {}
+  else if VG_BINT_CLO(arg, "--fork-jobs"    , ForkJobs, 1, 1024   ) {}
+  else if VG_XACT_CLO(arg, "--inject-mode=eager", InjectMode, BF_INJECT_EAGER) {}
+  else if VG_XACT_CLO(arg, "--inject-mode=lazy" , InjectMode, BF_INJECT_LAZY ) {}
+  else if VG_BOOL_CLO(arg, "--expose-heap"  , ExposeHeap     ) {}
+  else if VG_BOOL_CLO(arg, "--expose-stack" , ExposeStack    ) {}
+  else if VG_STR_CLO (arg, "--register-fault-rate", RegisterFaultRateSpec) {}
+  else if VG_STR_CLO (arg, "--mcu-density"  , McuDensitySpec ) {}
+  else if VG_BINT_CLO(arg, "--mcu-interleave", McuInterleave, 1,
+                      BF_MAX_MCU_INTERLEAVE) {}
+  else if VG_STR_CLO (arg, "--expose-globals", pattern) {
+    BF_(addPattern)(&ExposeGlobals, "--expose-globals", pattern);
+  }
+  else {
+    return VG_(replacement_malloc_process_cmd_line_option)(arg);
   }
 
   return True;
@@ -660,10 +3146,45 @@ BF_(usage) (void)
 {
    VG_(printf)
    ( 
-     "    --fault-rate=<int>      (units: faults per KB-instruction)\n"
+     "    --fault-rate=<float>[/insn|/s]  (units: faults per KB-instruction\n"
+     "                            or per KB-second, SI prefixes allowed)\n"
+     "    --insn-rate=<float>     instructions per second for /s rates\n"
+     "                            (default: " BF_DEFAULT_INSN_RATE ")\n"
      "    --inject-faults=yes|no  (default: yes)\n"
      "    --seed=<int>            (default: 42)\n"
-     "    --verbose=yes|no        (default: no)\n\n"
+     "    --verbose=yes|no        (default: no)\n"
+     "    --fault-schedule=poisson|skip  (default: poisson)\n"
+     "    --fault-check=helper|inline|superblock  (default: helper)\n"
+     "    --rate-unit=stmt|insn   (default: stmt)\n"
+     "    --rng=lcg|xoshiro       (default: lcg)\n"
+     "    --flip-density=<bits>:<weight>,...\n"
+     "                            (default: " BF_DEFAULT_FLIP_DENSITY ")\n"
+     "    --flip-density-file=<file>  read --flip-density from file\n"
+     "    --trace-file=<file>     write a binary trace of every SEU to file\n"
+     "    --skip-idle=yes|no      leave code uninstrumented while no SEU can\n"
+     "                            occur (default: no)\n"
+     "    --inject-in-fn=<glob>   only check faults in matching functions\n"
+     "    --inject-in-obj=<glob>  only check faults in matching objects\n"
+     "    --exclude-obj=<glob>    never check faults in matching objects\n"
+     "                            (each may be repeated)\n"
+     "    --outside-time=stop|bulk  fault clock outside selected code\n"
+     "                            (default: stop)\n"
+     "    --fork-runs=<n>         fork n runs at the first VALGRIND_BITFLIPS_ON\n"
+     "                            (default: 0, off; needs --inject-faults=no)\n"
+     "    --fork-jobs=<n>         forked runs at a time (default: 1)\n"
+     "    --inject-mode=eager|lazy  flip bits when the SEU occurs, or when\n"
+     "                            the element is next read (default: eager)\n"
+     "    --expose-heap=yes|no    expose every live heap block (default: no)\n"
+     "    --expose-globals=<glob> expose matching global variables (may be\n"
+     "                            repeated; needs --read-var-info=yes)\n"
+     "    --expose-stack=yes|no   expose every thread's stack (default: no)\n"
+     "    --register-fault-rate=<float>[/insn|/s]  SEUs per register bit per\n"
+     "                            instruction or second (default: 0)\n"
+     "    --mcu-density=<bits>:<weight>,...  make every SEU a cluster of\n"
+     "                            adjacent bits of the given lengths\n"
+     "                            (default: off)\n"
+     "    --mcu-interleave=<k>    physical interleaving of --mcu-density\n"
+     "                            clusters across elements (default: 1)\n\n"
    );
 }
 
@@ -678,38 +3199,249 @@ BF_(usage_debug) (void)
 static void
 BF_(finalize) (Int exitcode)
 {
-  float rate   = FaultCount / KilobyteFlux;
-  UInt* rate_p = (UInt*) &rate;
+  HChar rate  [BF_VALUE_FORMAT_SIZE];
+  HChar relerr[BF_VALUE_FORMAT_SIZE];
+
+
+  BF_(reschedule)();
+  BF_(Trace_close)(FaultCount, InstructionCount, KilobyteFlux);
+
+  BF_(Value_format)(rate, FaultCount / KilobyteFlux, 6);
 
   VG_(message)(Vg_UserMsg,
          "---------------------------------------------------------\n");
-  VG_(message)(Vg_UserMsg, "Total Bit Flips: %d\n", FaultCount);
+  VG_(message)(Vg_UserMsg, "Total Bit Flips: %u\n", FaultCount);
   VG_(message)(Vg_UserMsg, "Total Instructions: %lu\n",
                (long unsigned int)InstructionCount);
-  VG_(message)(Vg_UserMsg, "Fault Rate: %08x\n", *rate_p);
+  VG_(message)(Vg_UserMsg, "Fault Rate: %s\n", rate);
+
+  BF_(Value_format)(relerr, MaxRelError, 4);
+
+  VG_(message)(Vg_UserMsg, "Float Bit Flips: %llu\n", FloatFaultCount);
+  VG_(message)(Vg_UserMsg, "Non-finite Results: %llu\n", NonFiniteCount);
+  VG_(message)(Vg_UserMsg, "Max Relative Error: %s\n", relerr);
+
+  if (ExposeHeap)
+  {
+    VG_(message)(Vg_UserMsg, "Heap Blocks: %llu\n", HeapBlocks);
+  }
+
+  if (ExposeGlobals.n > 0)
+  {
+    VG_(message)(Vg_UserMsg, "Global Blocks: %llu\n", GlobalBlocks);
+  }
+
+  if (RegisterFaultRate > 0)
+  {
+    VG_(message)(Vg_UserMsg, "Register Bit Flips: %llu\n",
+                 RegisterFaultCount);
+  }
+
+  if (McuDensitySpec != 0)
+  {
+    VG_(message)(Vg_UserMsg, "Multi-cell Upsets: %llu\n", McuEvents);
+  }
+
+  if (InjectMode == BF_INJECT_LAZY)
+  {
+    HChar           avf[BF_VALUE_FORMAT_SIZE];
+    VgBF_Pending_t* p;
+
+    // SEUs still pending at exit were never read
+    VG_(OSetGen_ResetIter)(Pending);
+    while ( (p = VG_(OSetGen_Next)(Pending)) != 0 ) LazyLatent += p->events;
+
+    BF_(Value_format)(avf, (LazyScheduled == 0) ? 0.0 :
+                           (double) LazyActivated / LazyScheduled, 4);
+
+    VG_(message)(Vg_UserMsg, "Lazy SEUs: %llu\n", LazyScheduled);
+    VG_(message)(Vg_UserMsg, "Activated: %llu\n", LazyActivated);
+    VG_(message)(Vg_UserMsg, "Masked: %llu\n"   , LazyMasked);
+    VG_(message)(Vg_UserMsg, "Latent: %llu\n"   , LazyLatent);
+    VG_(message)(Vg_UserMsg, "AVF: %s\n"        , avf);
+  }
   VG_(message)(Vg_UserMsg,
          "---------------------------------------------------------\n");
 }
 
 
+static void
+BF_(printPatterns) (const HChar* option, const VgBF_Patterns_t* patterns)
+{
+  UInt i;
+
+
+  for (i = 0; i < patterns->n; ++i)
+  {
+    VG_(message)(Vg_UserMsg, "%s: %s\n", option, patterns->pattern[i]);
+  }
+}
+
+
 static void
 BF_(post_clo_init) (void)
 {  
-  UInt*       rate    = (UInt*) &FaultRate;
+  HChar       rate[BF_VALUE_FORMAT_SIZE];
   const char* inject  = FaultInjection ? "yes" : "no";
   const char* verbose = Verbose        ? "yes" : "no";
+  const char* sched   = (FaultSchedule == BF_SCHEDULE_SKIP) ? "skip" : "poisson";
+  const char* check   = (FaultCheck == BF_CHECK_INLINE)     ? "inline"     :
+                        (FaultCheck == BF_CHECK_SUPERBLOCK) ? "superblock" :
+                                                              "helper";
+  const char* unit    = (RateUnit == BF_UNIT_INSN) ? "insn" : "stmt";
+  const char* rng     = (RngKind == BF_RNG_XOSHIRO) ? "xoshiro" : "lcg";
+  const char* mode    = (InjectMode == BF_INJECT_LAZY) ? "lazy" : "eager";
+
+
+  if (FaultCheck == BF_CHECK_INLINE && FaultSchedule != BF_SCHEDULE_SKIP)
+  {
+    VG_(fmsg_bad_option)("--fault-check=inline",
+                         "requires --fault-schedule=skip\n");
+  }
 
+  // Every forked run would inherit the SEUs of the shared prefix
+  if (ForkRuns > 0 && FaultInjection)
+  {
+    VG_(fmsg_bad_option)("--fork-runs",
+                         "requires --inject-faults=no\n");
+  }
+
+
+  BF_(initFaultRate)();
+  BF_(initRegisters)();
+  BF_(Value_format)(rate, FaultRate, 6);
 
-  VG_(message)(Vg_UserMsg, "fault-rate: %08x\n" , *rate   );
+  VG_(message)(Vg_UserMsg, "fault-rate: %s\n"   , rate    );
+
+  if (RegisterFaultRate > 0)
+  {
+    BF_(Value_format)(rate, RegisterFaultRate, 6);
+    VG_(message)(Vg_UserMsg, "register-fault-rate: %s\n", rate);
+  }
   VG_(message)(Vg_UserMsg, "inject-faults: %s\n", inject  );
-  VG_(message)(Vg_UserMsg, "seed: %d\n"         , RandomState);
+  VG_(message)(Vg_UserMsg, "seed: %u\n"         , RandomSeed);
   VG_(message)(Vg_UserMsg, "verbose: %s\n"      , verbose );
+  VG_(message)(Vg_UserMsg, "fault-schedule: %s\n", sched   );
+  VG_(message)(Vg_UserMsg, "fault-check: %s\n"   , check   );
+  VG_(message)(Vg_UserMsg, "rate-unit: %s\n"     , unit    );
+  VG_(message)(Vg_UserMsg, "rng: %s\n"           , rng     );
+  VG_(message)(Vg_UserMsg, "inject-mode: %s\n"   , mode    );
+  VG_(message)(Vg_UserMsg, "expose-heap: %s\n"   , ExposeHeap ? "yes" : "no");
+  VG_(message)(Vg_UserMsg, "expose-stack: %s\n"  , ExposeStack ? "yes" : "no");
+  BF_(printPatterns)("expose-globals", &ExposeGlobals);
+
+  if (FlipDensityFile != 0)
+  {
+    VG_(message)(Vg_UserMsg, "flip-density-file: %s\n", FlipDensityFile);
+  }
+  else
+  {
+    VG_(message)(Vg_UserMsg, "flip-density: %s\n", FlipDensitySpec);
+  }
+
+  if (McuDensitySpec != 0)
+  {
+    VG_(message)(Vg_UserMsg, "mcu-density: %s (interleave %u)\n",
+                 McuDensitySpec, McuInterleave);
+  }
+
+  BF_(Random_seed)(RngKind, RandomSeed);
+  BF_(initFlipDensity)();
+  BF_(initMcuDensity)();
+
+  RegisterCountdown = BF_(drawRegisterGap)();
+
+  if (TraceFile != 0)
+  {
+    HChar* path = VG_(expand_file_name)("--trace-file", TraceFile);
+
+    if (!BF_(Trace_open)(path, RandomSeed, FaultRate))
+    {
+      VG_(fmsg_bad_option)("--trace-file", "cannot create '%s'\n", path);
+    }
+
+    VG_(message)(Vg_UserMsg, "trace-file: %s\n", path);
+  }
+
+  if (ForkRuns > 0)
+  {
+    VG_(message)(Vg_UserMsg, "fork-runs: %u (%u at a time)\n",
+                 ForkRuns, ForkJobs);
+  }
+
+  if (InjectFns.n > 0 || InjectObjs.n > 0 || ExcludeObjs.n > 0)
+  {
+    BF_(printPatterns)("inject-in-fn" , &InjectFns);
+    BF_(printPatterns)("inject-in-obj", &InjectObjs);
+    BF_(printPatterns)("exclude-obj"  , &ExcludeObjs);
+    VG_(message)(Vg_UserMsg, "outside-time: %s\n",
+                 (OutsideTime == BF_OUTSIDE_BULK) ? "bulk" : "stop");
+  }
+
+  // Only track memory events that are needed: stack tracking in
+  // particular adds a helper call to every stack pointer change
+  if (InjectMode == BF_INJECT_LAZY)
+  {
+    VG_(track_pre_mem_read)       ( BF_(preSyscallRead)       );
+    VG_(track_pre_mem_read_asciiz)( BF_(preSyscallReadString) );
+    VG_(track_post_mem_write)     ( BF_(postSyscallWrite)     );
+  }
+
+  if (ExposeGlobals.n > 0)
+  {
+    VG_(track_new_mem_startup)( BF_(newGlobals) );
+    VG_(track_new_mem_mmap)   ( BF_(newGlobals) );
+  }
+
+  if (ExposeStack)
+  {
+    Stacks = VG_(calloc)("bf.stacks", VG_N_THREADS, sizeof(Addr));
+    VG_(track_new_mem_stack)     ( BF_(newStack)  );
+    VG_(track_pre_thread_ll_exit)( BF_(dieThread) );
+  }
+
+  if (ExposeGlobals.n > 0 || ExposeStack)
+  {
+    VG_(track_die_mem_munmap)( BF_(dieMapping) );
+  }
+
+  // No blocks are exposed yet, so with --skip-idle the program starts
+  // uninstrumented unless registers are
+  Idle = SkipIdle && RegisterCountdown == ~0ULL;
+
+  VG_(message)(Vg_UserMsg, "skip-idle: %s\n", SkipIdle ? "yes" : "no");
 }
 
 
 static void
 BF_(pre_clo_init) (void)
 {
+  BF_(Exposure_init)(&Exposure);
+
+  // MemBlock records come from a fixed-size pool and descriptions are
+  // interned, so registration churn in a loop does not allocate
+  MemBlocks = VG_(OSetGen_Create_With_Pool)( offsetof(VgBF_MemBlock_t, start)
+                                           , NULL
+                                           , VG_(malloc)
+                                           , "bf.blocks"
+                                           , VG_(free)
+                                           , 1000
+                                           , sizeof(VgBF_MemBlock_t) );
+
+  Pending = VG_(OSetGen_Create)( offsetof(VgBF_Pending_t, addr)
+                              , NULL
+                              , VG_(malloc)
+                              , "bf.pending"
+                              , VG_(free) );
+
+  Shadowed = VG_(OSetGen_Create)( offsetof(VgBF_Shadowed_t, start)
+                               , NULL
+                               , VG_(malloc)
+                               , "bf.shadowed"
+                               , VG_(free) );
+
+  Descs = VG_(newDedupPA)(16000, 1, VG_(malloc), "bf.descs", VG_(free));
+
   VG_(details_name)            ("BITFLIPS");
   VG_(details_version)         ("2.0.0");
   VG_(details_description)     ("Injects SEUs into a running program");
@@ -731,6 +3463,23 @@ BF_(pre_clo_init) (void)
   );
 
   VG_(needs_client_requests)( BF_(handle_client_request) );
+
+  // The malloc replacement is always in place (vgpreload_bitflips
+  // requires it), but only registers blocks with --expose-heap=yes
+  VG_(needs_malloc_replacement)
+  (
+     BF_(malloc)
+   , BF_(__builtin_new)
+   , BF_(__builtin_vec_new)
+   , BF_(memalign)
+   , BF_(calloc)
+   , BF_(free)
+   , BF_(__builtin_delete)
+   , BF_(__builtin_vec_delete)
+   , BF_(realloc)
+   , BF_(malloc_usable_size)
+   , 0
+  );
 }
 
 
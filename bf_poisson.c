@@ -104,24 +104,32 @@ static int random_poisson_mult(double lambda, double (*next_double)(void)) {
  * The transformed rejection method for generating Poisson random variables
  * W. Hoermann
  * Insurance: Mathematics and Economics 12, 39-45 (1993)
+ *
+ * The constants depend only on lambda and are computed once by
+ * random_poisson_ptrs_init().
  */
-static int random_poisson_ptrs(double lambda, double (*next_double)(void)) {
-    int k;
-    double U, V, slam, loglam, a, b, invalpha, vr, us;
+static void random_poisson_ptrs_init(random_poisson_sampler *s, double lambda) {
+    s->slam = sqrt(lambda);
+    s->loglam = log(lambda);
+    s->b = 0.931 + 2.53 * s->slam;
+    s->a = -0.059 + 0.02483 * s->b;
+    s->invalpha = 1.1239 + 1.1328 / (s->b - 3.4);
+    s->loginvalpha = log(s->invalpha);
+    s->vr = 0.9277 - 3.6224 / (s->b - 2);
+}
 
-    slam = sqrt(lambda);
-    loglam = log(lambda);
-    b = 0.931 + 2.53 * slam;
-    a = -0.059 + 0.02483 * b;
-    invalpha = 1.1239 + 1.1328 / (b - 3.4);
-    vr = 0.9277 - 3.6224 / (b - 2);
+static int random_poisson_ptrs_draw(const random_poisson_sampler *s,
+                                    double (*next_double)(void)) {
+    int k;
+    double U, V, us;
+    double lambda = s->lambda, a = s->a, b = s->b;
 
     while (1) {
         U = next_double() - 0.5;
         V = next_double();
         us = 0.5 - fabs(U);
         k = (int)floor((2 * a / us + b) * U + lambda + 0.43);
-        if ((us >= 0.07) && (V <= vr)) {
+        if ((us >= 0.07) && (V <= s->vr)) {
             return k;
         }
         if ((k < 0) || ((us < 0.013) && (V > us))) {
@@ -129,13 +137,21 @@ static int random_poisson_ptrs(double lambda, double (*next_double)(void)) {
         }
         /* log(V) == log(0.0) ok here */
         /* if U==0.0 so that us==0.0, log is ok since always returns */
-        if ((log(V) + log(invalpha) - log(a / (us * us) + b)) <=
-            (-lambda + k * loglam - random_loggam(k + 1))) {
+        if ((log(V) + s->loginvalpha - log(a / (us * us) + b)) <=
+            (-lambda + k * s->loglam - random_loggam(k + 1))) {
             return k;
         }
     }
 }
 
+static int random_poisson_ptrs(double lambda, double (*next_double)(void)) {
+    random_poisson_sampler s;
+
+    s.lambda = lambda;
+    random_poisson_ptrs_init(&s, lambda);
+    return random_poisson_ptrs_draw(&s, next_double);
+}
+
 /**
  *  Return a Poisson-distributed random variable with rate parameter lambda and
  *  source of double values drawn uniformly at random from [0, 1].
@@ -149,3 +165,161 @@ int random_poisson(double lambda, double (*next_double)(void)) {
         return random_poisson_mult(lambda, next_double);
     }
 }
+
+/*
+ * Zero-truncated normalizer e^lambda - 1 for lambda < 1, summed as a
+ * series to avoid the cancellation in e^lambda - 1 when lambda is tiny.
+ */
+static double random_poisson_positive_norm(double lambda) {
+    int k;
+    double norm = 0.0, term = lambda;
+
+    for (k = 1; term > norm * 1e-17; k++) {
+        norm += term;
+        term *= lambda / (k + 1);
+    }
+    return norm;
+}
+
+/*
+ * Inverts the zero-truncated PMF lambda^k / (k! norm) for lambda < 1.
+ */
+static int random_poisson_positive_invert(double lambda, double norm,
+                                          double (*next_double)(void)) {
+    int k;
+    double term = lambda, target = next_double() * norm;
+
+    for (k = 1; target > term && term > 0; k++) {
+        target -= term;
+        term *= lambda / (k + 1);
+    }
+    return k;
+}
+
+/**
+ *  Return a zero-truncated Poisson-distributed random variable, i.e. a
+ *  Poisson(lambda) variate conditioned on being at least one.
+ *
+ *  For lambda >= 1 at least 63% of ordinary draws are accepted, so
+ *  simple rejection is used.  For smaller lambda the conditional PMF is
+ *  inverted directly.
+ */
+int random_poisson_positive(double lambda, double (*next_double)(void)) {
+    int k;
+
+    if (lambda >= 1) {
+        do {
+            k = random_poisson(lambda, next_double);
+        } while (k == 0);
+        return k;
+    }
+
+    return random_poisson_positive_invert(
+        lambda, random_poisson_positive_norm(lambda), next_double);
+}
+
+/**
+ *  Precompute everything random_poisson_sampler_draw() needs for a fixed
+ *  lambda: the cumulative probability table for the inversion method
+ *  (lambda < 10), the PTRS constants (lambda >= 10) and the
+ *  zero-truncated normalizer.
+ */
+void random_poisson_sampler_init(random_poisson_sampler *s, double lambda) {
+    int k;
+    double p, cdf;
+
+    s->lambda = lambda;
+    s->table_size = 0;
+    s->positive_norm = (lambda < 1) ? random_poisson_positive_norm(lambda) : 0;
+
+    if (lambda >= 10) {
+        random_poisson_ptrs_init(s, lambda);
+        return;
+    }
+
+    s->enlam = exp(-lambda);
+    p = s->enlam;
+    cdf = 0.0;
+    for (k = 0; k < RANDOM_POISSON_TABLE_SIZE; k++) {
+        cdf += p;
+        s->cdf[k] = cdf;
+        p *= lambda / (k + 1);
+    }
+    s->table_size = RANDOM_POISSON_TABLE_SIZE;
+    s->tail_pmf = p;
+}
+
+/**
+ *  Return a Poisson-distributed random variable using a sampler prepared
+ *  by random_poisson_sampler_init().  For lambda < 10 this is a search of
+ *  the cumulative table, which for small lambda almost always ends at the
+ *  first entry after a single uniform draw.
+ */
+int random_poisson_sampler_draw(const random_poisson_sampler *s,
+                                double (*next_double)(void)) {
+    int k;
+    double U, p, cdf;
+
+    if (s->lambda == 0) {
+        return 0;
+    } else if (s->table_size == 0) {
+        return random_poisson_ptrs_draw(s, next_double);
+    }
+
+    U = next_double();
+    for (k = 0; k < s->table_size; k++) {
+        if (U < s->cdf[k]) {
+            return k;
+        }
+    }
+
+    /* Far tail, beyond the table: continue the sequential search */
+    p = s->tail_pmf;
+    cdf = s->cdf[s->table_size - 1];
+    for (k = s->table_size; p > 0; k++) {
+        cdf += p;
+        if (U < cdf) {
+            return k;
+        }
+        p *= s->lambda / (k + 1);
+    }
+    return k;
+}
+
+/**
+ *  Return a zero-truncated Poisson-distributed random variable using a
+ *  sampler prepared by random_poisson_sampler_init().
+ */
+int random_poisson_sampler_draw_positive(const random_poisson_sampler *s,
+                                         double (*next_double)(void)) {
+    int k;
+
+    if (s->lambda < 1) {
+        return random_poisson_positive_invert(s->lambda, s->positive_norm,
+                                              next_double);
+    }
+
+    do {
+        k = random_poisson_sampler_draw(s, next_double);
+    } while (k == 0);
+    return k;
+}
+
+/**
+ *  Return the number of trials up to and including the next one on which
+ *  a Poisson process with lambda events per trial has at least one event,
+ *  or ~0 if lambda is not positive or the gap does not fit.  Each trial is
+ *  event-free with probability exp(-lambda), so the number of event-free
+ *  trials before the next event is floor(E / lambda) for an Exp(1)
+ *  variate E.
+ */
+unsigned long long random_poisson_gap(double lambda,
+                                      double (*next_double)(void)) {
+    double gap;
+
+    if (lambda <= 0) {
+        return ~0ULL;
+    }
+    gap = -log(1.0 - next_double()) / lambda;
+    return (gap < 1.8e19) ? (unsigned long long)gap + 1 : ~0ULL;
+}
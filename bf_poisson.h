@@ -1,10 +1,66 @@
 #ifndef __BITFLIPS_POISSON_H
 #define __BITFLIPS_POISSON_H
 
+#define RANDOM_POISSON_TABLE_SIZE 48
+
+/**
+ *  Precomputed state for repeatedly drawing Poisson variates with the
+ *  same rate parameter lambda (see random_poisson_sampler_init()).
+ */
+typedef struct {
+    double lambda;
+
+    /* Inversion method (lambda < 10) */
+    int    table_size;
+    double enlam;
+    double cdf[RANDOM_POISSON_TABLE_SIZE];
+    double tail_pmf;
+
+    /* Transformed rejection method (lambda >= 10) */
+    double slam, loglam, a, b, invalpha, loginvalpha, vr;
+
+    /* Zero-truncated inversion (lambda < 1) */
+    double positive_norm;
+} random_poisson_sampler;
+
 /**
  *  Return a Poisson-distributed random variable with rate parameter lambda and
  *  source of double values drawn uniformly at random from [0, 1].
  */
 int random_poisson(double lambda, double (*next_double)(void));
 
+/**
+ *  Return a zero-truncated Poisson-distributed random variable, i.e. a
+ *  Poisson(lambda) variate conditioned on being at least one.
+ */
+int random_poisson_positive(double lambda, double (*next_double)(void));
+
+/**
+ *  Precompute the state needed to draw Poisson variates with rate
+ *  parameter lambda.
+ */
+void random_poisson_sampler_init(random_poisson_sampler *s, double lambda);
+
+/**
+ *  Return a Poisson-distributed random variable from a sampler prepared by
+ *  random_poisson_sampler_init().
+ */
+int random_poisson_sampler_draw(const random_poisson_sampler *s,
+                                double (*next_double)(void));
+
+/**
+ *  Return a zero-truncated Poisson-distributed random variable from a
+ *  sampler prepared by random_poisson_sampler_init().
+ */
+int random_poisson_sampler_draw_positive(const random_poisson_sampler *s,
+                                         double (*next_double)(void));
+
+/**
+ *  Return the number of trials up to and including the next one on which
+ *  a Poisson process with lambda events per trial has at least one event,
+ *  or ~0 if lambda is not positive or the gap does not fit.
+ */
+unsigned long long random_poisson_gap(double lambda,
+                                      double (*next_double)(void));
+
 #endif  /* __BITFLIPS_POISSON_H */
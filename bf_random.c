@@ -0,0 +1,191 @@
+/** 
+ * \file    bf_random.c
+ * \brief   Valgrind Tool: BITFLIPS pseudo-random number generation
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+#include "pub_tool_basics.h"
+#include "pub_tool_libcbase.h"
+
+#include "bf_random.h"
+
+
+#define BF_RANDOM_BUFFER_SIZE 256
+
+/* 2^-53: scales the top 53 bits of a 64-bit word to [0, 1) */
+#define BF_RANDOM_DOUBLE_UNIT (1.0 / 9007199254740992.0)
+
+
+static VgBF_RngKind_t  RngKind    = BF_RNG_LCG;
+static UInt            LcgState   = 42;
+static ULong           XoshiroState[4];
+
+static double          Buffer[BF_RANDOM_BUFFER_SIZE];
+static UInt            BufferNext = BF_RANDOM_BUFFER_SIZE;
+
+
+static inline ULong
+BF_(rotl) (ULong x, Int k)
+{
+  return (x << k) | (x >> (64 - k));
+}
+
+
+/**
+ * splitmix64, used to expand a seed into the xoshiro256** state as
+ * recommended by its authors.
+ */
+static ULong
+BF_(splitmix64) (ULong* x)
+{
+  ULong z = (*x += 0x9e3779b97f4a7c15ULL);
+
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+
+static inline ULong
+BF_(xoshiro256ss) (void)
+{
+  ULong* s      = XoshiroState;
+  ULong  result = BF_(rotl)(s[1] * 5, 7) * 9;
+  ULong  t      = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3]  = BF_(rotl)(s[3], 45);
+
+  return result;
+}
+
+
+void
+BF_(Random_seed) (VgBF_RngKind_t kind, ULong seed)
+{
+  ULong x = seed;
+
+
+  RngKind    = kind;
+  LcgState   = (UInt) seed;
+  BufferNext = BF_RANDOM_BUFFER_SIZE;
+
+  XoshiroState[0] = BF_(splitmix64)(&x);
+  XoshiroState[1] = BF_(splitmix64)(&x);
+  XoshiroState[2] = BF_(splitmix64)(&x);
+  XoshiroState[3] = BF_(splitmix64)(&x);
+}
+
+
+ULong
+BF_(Random_next64) (void)
+{
+  ULong hi;
+
+
+  if (RngKind == BF_RNG_XOSHIRO) return BF_(xoshiro256ss)();
+
+  hi = VG_(random)(&LcgState);
+  return (hi << 32) | VG_(random)(&LcgState);
+}
+
+
+/**
+ * @return 32 uniformly random bits.
+ */
+static inline UInt
+BF_(Random_next32) (void)
+{
+  return (RngKind == BF_RNG_XOSHIRO) ?
+    (UInt) (BF_(xoshiro256ss)() >> 32) : VG_(random)(&LcgState);
+}
+
+
+UInt
+BF_(Random_below32) (UInt n)
+{
+  ULong m = (ULong) BF_(Random_next32)() * n;
+  UInt  l = (UInt) m;
+
+
+  if (l < n)
+  {
+    UInt threshold = -n % n;
+
+    while (l < threshold)
+    {
+      m = (ULong) BF_(Random_next32)() * n;
+      l = (UInt) m;
+    }
+  }
+
+  return (UInt) (m >> 32);
+}
+
+
+ULong
+BF_(Random_below64) (ULong n)
+{
+  ULong mask = n - 1;
+  ULong x;
+
+
+  if (n <= 0xffffffffULL) return BF_(Random_below32)((UInt) n);
+
+  mask |= mask >> 1;
+  mask |= mask >> 2;
+  mask |= mask >> 4;
+  mask |= mask >> 8;
+  mask |= mask >> 16;
+  mask |= mask >> 32;
+
+  do
+  {
+    x = BF_(Random_next64)() & mask;
+  } while (x >= n);
+
+  return x;
+}
+
+
+void
+BF_(Random_fill) (double* out, UInt n)
+{
+  UInt i;
+
+
+  if (RngKind == BF_RNG_XOSHIRO)
+  {
+    for (i = 0; i < n; ++i)
+    {
+      out[i] = (BF_(xoshiro256ss)() >> 11) * BF_RANDOM_DOUBLE_UNIT;
+    }
+  }
+  else
+  {
+    for (i = 0; i < n; ++i)
+    {
+      out[i] = (BF_(Random_next64)() >> 11) * BF_RANDOM_DOUBLE_UNIT;
+    }
+  }
+}
+
+
+double
+BF_(Random_uniform) (void)
+{
+  if (BufferNext == BF_RANDOM_BUFFER_SIZE)
+  {
+    BF_(Random_fill)(Buffer, BF_RANDOM_BUFFER_SIZE);
+    BufferNext = 0;
+  }
+
+  return Buffer[BufferNext++];
+}
@@ -0,0 +1,67 @@
+/** 
+ * \file    bf_random.h
+ * \brief   Valgrind Tool: BITFLIPS pseudo-random number generation
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+
+#ifndef __BITFLIPS_RANDOM_H
+#define __BITFLIPS_RANDOM_H
+
+
+#include "bf_include.h"
+
+
+/**
+ * The pseudo-random number generators available to BITFLIPS.
+ *
+ * BF_RNG_LCG is Valgrind's 32-bit linear congruential VG_(random).
+ * BF_RNG_XOSHIRO is xoshiro256** (Blackman and Vigna), a 64-bit
+ * generator with a 2^256 - 1 period that passes BigCrush.
+ */
+typedef enum
+{
+    BF_RNG_LCG
+  , BF_RNG_XOSHIRO
+} VgBF_RngKind_t;
+
+
+/**
+ * Selects the generator kind and seeds it with seed.  Any buffered
+ * uniforms are discarded.
+ */
+void   BF_(Random_seed)    (VgBF_RngKind_t kind, ULong seed);
+
+/**
+ * @return 64 uniformly random bits.
+ */
+ULong  BF_(Random_next64)  (void);
+
+/**
+ * @return a uniform random integer in [0, n - 1], n > 0, without modulo
+ * bias (Lemire's multiply-and-reject method).
+ */
+UInt   BF_(Random_below32) (UInt n);
+
+/**
+ * @return a uniform random integer in [0, n - 1], n > 0, without modulo
+ * bias (bitmask rejection).
+ */
+ULong  BF_(Random_below64) (ULong n);
+
+/**
+ * @return a uniform random double in [0, 1) with 53 random bits.
+ * Values are served from a buffer refilled by BF_(Random_fill).
+ */
+double BF_(Random_uniform) (void);
+
+/**
+ * Fills out[0 .. n - 1] with uniform random doubles in [0, 1).
+ */
+void   BF_(Random_fill)    (double* out, UInt n);
+
+
+#endif  /* __BITFLIPS_RANDOM_H */
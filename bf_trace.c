@@ -0,0 +1,201 @@
+/** 
+ * \file    bf_trace.c
+ * \brief   Valgrind Tool: BITFLIPS binary fault trace
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+#include "pub_tool_basics.h"
+#include "pub_tool_libcassert.h"
+#include "pub_tool_libcbase.h"
+#include "pub_tool_libcfile.h"
+#include "pub_tool_libcprint.h"
+#include "pub_tool_mallocfree.h"
+#include "pub_tool_vki.h"
+
+#include "bf_trace.h"
+
+
+/* Records are collected in memory and written in bulk */
+#define BF_TRACE_BUFFER_SIZE (4 * 1024 * 1024)
+
+#define BF_TRACE_ALIGN(n) (((n) + 7) & ~7)
+
+
+static Int     TraceFd     = -1;
+static UChar*  TraceBuffer = 0;
+static SizeT   TraceUsed   = 0;
+
+
+/**
+ * Writes the buffered records to the trace file.
+ */
+static void
+BF_(Trace_flush) (void)
+{
+  SizeT done = 0;
+  Int   n;
+
+
+  while (done < TraceUsed)
+  {
+    n = VG_(write)(TraceFd, TraceBuffer + done, TraceUsed - done);
+
+    if (n <= 0)
+    {
+      VG_(message)(Vg_UserMsg, "BITFLIPS: error writing trace file; "
+                               "tracing disabled\n");
+      VG_(close)(TraceFd);
+      TraceFd = -1;
+      break;
+    }
+
+    done += n;
+  }
+
+  TraceUsed = 0;
+}
+
+
+/**
+ * @return space for a record of size bytes (a multiple of 8) in the
+ * buffer, flushing it first if necessary.
+ */
+static void*
+BF_(Trace_reserve) (SizeT size)
+{
+  void* record;
+
+
+  tl_assert(size <= BF_TRACE_BUFFER_SIZE);
+
+  if (TraceUsed + size > BF_TRACE_BUFFER_SIZE) BF_(Trace_flush)();
+
+  record     = TraceBuffer + TraceUsed;
+  TraceUsed += size;
+
+  VG_(memset)(record, 0, size);
+
+  return record;
+}
+
+
+Bool
+BF_(Trace_open) (const HChar* path, UInt seed, double fault_rate)
+{
+  SysRes              res;
+  VgBF_TraceHeader_t* header;
+
+
+  res = VG_(open)(path, VKI_O_CREAT | VKI_O_TRUNC | VKI_O_WRONLY,
+                  VKI_S_IRUSR | VKI_S_IWUSR | VKI_S_IRGRP | VKI_S_IROTH);
+
+  if (sr_isError(res)) return False;
+
+  TraceFd     = sr_Res(res);
+  TraceBuffer = VG_(malloc)("bf.trace", BF_TRACE_BUFFER_SIZE);
+  TraceUsed   = 0;
+
+  header = BF_(Trace_reserve)(sizeof(VgBF_TraceHeader_t));
+
+  VG_(strcpy)(header->magic, BF_TRACE_MAGIC);
+  header->version     = BF_TRACE_VERSION;
+  header->header_size = sizeof(VgBF_TraceHeader_t);
+  header->endian      = BF_TRACE_ENDIAN;
+  header->seed        = seed;
+  header->fault_rate  = fault_rate;
+
+  return True;
+}
+
+
+/**
+ * Describes block in the trace.
+ */
+static void
+BF_(Trace_block) (VgBF_MemBlock_t* block)
+{
+  SizeT              len  = VG_(strlen)(block->desc);
+  SizeT              size = BF_TRACE_ALIGN(sizeof(VgBF_TraceBlock_t) + len + 1);
+  VgBF_TraceBlock_t* r    = BF_(Trace_reserve)(size);
+
+
+  r->record.kind = BF_TRACE_BLOCK;
+  r->record.size = size;
+  r->id          = block->id;
+  r->type        = block->type;
+  r->layout      = block->layout;
+  r->name_len    = len;
+  r->start       = block->start;
+  r->rows        = block->num_rows;
+  r->cols        = block->num_cols;
+
+  VG_(memcpy)(r + 1, block->desc, len);
+
+  block->traced = True;
+}
+
+
+void
+BF_(Trace_fault) (  VgBF_MemBlock_t*        block
+                  , ULong                   instruction
+                  , UInt                    row
+                  , UInt                    col
+                  , ULong                   original
+                  , ULong                   mask
+                  , ULong                   flipped
+                  , const VgBF_FlipValue_t* value )
+{
+  VgBF_TraceFault_t* r;
+
+
+  if (TraceFd < 0) return;
+
+  if (!block->traced) BF_(Trace_block)(block);
+
+  r = BF_(Trace_reserve)(sizeof(VgBF_TraceFault_t));
+
+  r->record.kind = BF_TRACE_FAULT;
+  r->record.size = sizeof(VgBF_TraceFault_t);
+  r->instruction = instruction;
+  r->block       = block->id;
+  r->type        = block->type;
+  r->row         = row;
+  r->col         = col;
+  r->original    = original;
+  r->mask        = mask;
+  r->flipped     = flipped;
+
+  r->original_value = value->original;
+  r->flipped_value  = value->flipped;
+  r->delta          = value->delta;
+  r->relerr         = value->relerr;
+}
+
+
+void
+BF_(Trace_close) (ULong faults, ULong instructions, double flux)
+{
+  VgBF_TraceEnd_t* r;
+
+
+  if (TraceFd < 0) return;
+
+  r = BF_(Trace_reserve)(sizeof(VgBF_TraceEnd_t));
+
+  r->record.kind   = BF_TRACE_END;
+  r->record.size   = sizeof(VgBF_TraceEnd_t);
+  r->faults        = faults;
+  r->instructions  = instructions;
+  r->kilobyte_flux = flux;
+
+  BF_(Trace_flush)();
+
+  if (TraceFd >= 0) VG_(close)(TraceFd);
+
+  TraceFd = -1;
+  VG_(free)(TraceBuffer);
+  TraceBuffer = 0;
+}
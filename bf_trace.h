@@ -0,0 +1,147 @@
+/** 
+ * \file    bf_trace.h
+ * \brief   Valgrind Tool: BITFLIPS binary fault trace
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+
+#ifndef __BITFLIPS_TRACE_H
+#define __BITFLIPS_TRACE_H
+
+
+#include "bf_include.h"
+#include "bf_value.h"
+
+
+/**
+ * Trace file format (--trace-file)
+ * ================================
+ *
+ * A trace file is a VgBF_TraceHeader_t followed by a sequence of
+ * records.  All fields are in the native byte order of the machine that
+ * wrote the trace, which readers can detect from the endian field.
+ * Every record starts with a VgBF_TraceRecord_t giving its kind and its
+ * total size in bytes (always a multiple of 8), so readers can skip
+ * kinds they do not know.
+ *
+ *   BF_TRACE_BLOCK  describes a registered MemBlock the first time one
+ *                   of its elements is hit; the NUL-terminated block
+ *                   description follows the fixed part, padded to a
+ *                   multiple of 8 bytes.
+ *
+ *   BF_TRACE_FAULT  describes one SEU in an element of a block
+ *                   previously described by a BF_TRACE_BLOCK record
+ *                   with the same id.
+ *
+ *   BF_TRACE_END    gives the run totals; it is the last record of a
+ *                   complete trace.
+ *
+ * Element values (original, mask, flipped) occupy the low-order
+ * 8 * sizeof(element) bits of their fields.  The same values decoded
+ * as the element type, their difference and the relative error follow
+ * as doubles (see VgBF_FlipValue_t).
+ *
+ * BF_TRACE_VERSION is incremented whenever a record layout changes.
+ */
+
+#define BF_TRACE_MAGIC    "BFTRACE"
+#define BF_TRACE_VERSION  2
+#define BF_TRACE_ENDIAN   0x01020304
+
+typedef enum
+{
+    BF_TRACE_BLOCK = 1
+  , BF_TRACE_FAULT = 2
+  , BF_TRACE_END   = 3
+} VgBF_TraceKind_t;
+
+
+typedef struct
+{
+  HChar   magic[8];      /* BF_TRACE_MAGIC, NUL-padded          */
+  UInt    version;       /* BF_TRACE_VERSION                    */
+  UInt    header_size;   /* sizeof(VgBF_TraceHeader_t)          */
+  UInt    endian;        /* BF_TRACE_ENDIAN                     */
+  UInt    seed;          /* --seed                              */
+  double  fault_rate;    /* SEUs / (KB * instruction)           */
+} VgBF_TraceHeader_t;
+
+
+typedef struct
+{
+  UInt    kind;          /* VgBF_TraceKind_t                    */
+  UInt    size;          /* Total record size in bytes          */
+} VgBF_TraceRecord_t;
+
+
+typedef struct
+{
+  VgBF_TraceRecord_t  record;
+  UInt                id;
+  UInt                type;      /* VgBF_MemType_t               */
+  UInt                layout;    /* VgBF_MemOrder_t              */
+  UInt                name_len;  /* strlen(name), excluding NUL  */
+  ULong               start;
+  ULong               rows;
+  ULong               cols;
+  /* HChar            name[name_len + 1], padded to 8 bytes */
+} VgBF_TraceBlock_t;
+
+
+typedef struct
+{
+  VgBF_TraceRecord_t  record;
+  ULong               instruction;
+  UInt                block;     /* VgBF_TraceBlock_t id         */
+  UInt                type;      /* VgBF_MemType_t               */
+  UInt                row;
+  UInt                col;
+  ULong               original;
+  ULong               mask;
+  ULong               flipped;
+  double              original_value;
+  double              flipped_value;
+  double              delta;
+  double              relerr;
+} VgBF_TraceFault_t;
+
+
+typedef struct
+{
+  VgBF_TraceRecord_t  record;
+  ULong               faults;
+  ULong               instructions;
+  double              kilobyte_flux;
+} VgBF_TraceEnd_t;
+
+
+/**
+ * Creates the trace file at path and writes its header.
+ *
+ * @return False if the file cannot be created.
+ */
+Bool BF_(Trace_open) (const HChar* path, UInt seed, double fault_rate);
+
+/**
+ * Records one SEU at (row, col) of block, with its decoded value, first
+ * describing block if it has not yet appeared in the trace.
+ */
+void BF_(Trace_fault) (  VgBF_MemBlock_t*        block
+                       , ULong                   instruction
+                       , UInt                    row
+                       , UInt                    col
+                       , ULong                   original
+                       , ULong                   mask
+                       , ULong                   flipped
+                       , const VgBF_FlipValue_t* value );
+
+/**
+ * Writes the BF_TRACE_END record, flushes and closes the trace file.
+ */
+void BF_(Trace_close) (ULong faults, ULong instructions, double flux);
+
+
+#endif  /* __BITFLIPS_TRACE_H */
@@ -0,0 +1,284 @@
+/**
+ * \file    bf_value.c
+ * \brief   Valgrind Tool: BITFLIPS element value decoding and printing
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+#include "pub_tool_basics.h"
+#include "pub_tool_libcbase.h"
+#include "pub_tool_libcprint.h"
+
+#include "bf_math.h"
+#include "bf_value.h"
+
+
+#define BF_LN10 2.30258509299404568402
+
+
+double
+BF_(Value_decode) (VgBF_MemType_t type, ULong bits)
+{
+  union { UInt  u; float  f; } f;
+  union { ULong u; double d; } d;
+
+
+  switch (type)
+  {
+    case BITFLIPS_CHAR:   return (Char)   bits;
+    case BITFLIPS_UCHAR:  return (UChar)  bits;
+    case BITFLIPS_SHORT:  return (Short)  bits;
+    case BITFLIPS_USHORT: return (UShort) bits;
+    case BITFLIPS_INT:    return (Int)    bits;
+    case BITFLIPS_UINT:   return (UInt)   bits;
+
+    case BITFLIPS_LONG:
+      return (sizeof(long) == sizeof(Long)) ? (double) (Long) bits :
+                                              (double) (Int)  bits;
+
+    case BITFLIPS_ULONG:
+      return (sizeof(long) == sizeof(Long)) ? (double) bits :
+                                              (double) (UInt) bits;
+
+    case BITFLIPS_FLOAT:
+      f.u = (UInt) bits;
+      return f.f;
+
+    case BITFLIPS_DOUBLE:
+      d.u = bits;
+      return d.d;
+
+    default:
+      return 0;
+  }
+}
+
+
+void
+BF_(Value_flip) (  VgBF_FlipValue_t* value
+                 , VgBF_MemType_t    type
+                 , ULong             original
+                 , ULong             flipped )
+{
+  value->original = BF_(Value_decode)(type, original);
+  value->flipped  = BF_(Value_decode)(type, flipped);
+  value->delta    = value->flipped - value->original;
+  value->relerr   = (value->delta == 0) ? 0 :
+                    fabs(value->delta) / fabs(value->original);
+}
+
+
+Bool
+BF_(Value_isFinite) (double x)
+{
+  return (x - x) == 0;
+}
+
+
+/**
+ * @return 10^n for n >= 0, by repeated squaring.  Exact for n <= 22.
+ */
+static double
+BF_(pow10) (UInt n)
+{
+  double result = 1.0;
+  double power  = 10.0;
+
+
+  while (n != 0)
+  {
+    if (n & 1) result *= power;
+
+    power *= power;
+    n    >>= 1;
+  }
+
+  return result;
+}
+
+
+/**
+ * @return x * 10^n, split in two steps near the ends of the double
+ * range where 10^|n| alone would overflow.
+ */
+static double
+BF_(scale10) (double x, Int n)
+{
+  if (n > 300)
+  {
+    x *= BF_(pow10)(300);
+    n -= 300;
+  }
+  else if (n < -300)
+  {
+    x /= BF_(pow10)(300);
+    n += 300;
+  }
+
+  return (n >= 0) ? x * BF_(pow10)(n) : x / BF_(pow10)(-n);
+}
+
+
+UInt
+BF_(Value_format) (HChar* buf, double x, UInt precision)
+{
+  HChar  digits[24];
+  HChar* p = buf;
+  ULong  n = 0;
+  ULong  limit;
+  double m;
+  Int    e = 0;
+  Int    i;
+
+
+  if (x != x) return VG_(sprintf)(buf, "nan");
+
+  if (x < 0 || (x == 0 && 1 / x < 0))
+  {
+    *p++ = '-';
+    x    = -x;
+  }
+
+  if ( !BF_(Value_isFinite)(x) )
+  {
+    return (p - buf) + VG_(sprintf)(p, "inf");
+  }
+
+  if (precision > 16) precision = 16;
+
+  for (limit = 1, i = 0; i < (Int) precision; ++i) limit *= 10;
+
+  // Normalize x to m * 10^e with 1 <= m < 10, correcting the estimate
+  // of e from log() by one when x is close to a power of ten, then
+  // round m to precision decimal places
+  if (x != 0)
+  {
+    e = (Int) floor( log(x) / BF_LN10 );
+    m = BF_(scale10)(x, -e);
+
+    if      (m >= 10) { m /= 10; e++; }
+    else if (m <  1)  { m *= 10; e--; }
+
+    n = (ULong) (m * limit + 0.5);
+
+    if (n >= 10 * limit)
+    {
+      n /= 10;
+      e++;
+    }
+  }
+
+  for (i = precision; i >= 0; --i)
+  {
+    digits[i] = '0' + (HChar) (n % 10);
+    n        /= 10;
+  }
+
+  *p++ = digits[0];
+
+  if (precision > 0)
+  {
+    *p++ = '.';
+    for (i = 1; i <= (Int) precision; ++i) *p++ = digits[i];
+  }
+
+  p += VG_(sprintf)(p, "e%c%02d", (e < 0) ? '-' : '+', (e < 0) ? -e : e);
+
+  return p - buf;
+}
+
+
+/**
+ * @return the power of ten of the SI prefix c, or 0 if c is not one.
+ */
+static Int
+BF_(siExponent) (HChar c)
+{
+  switch (c)
+  {
+    case 'a': return -18;
+    case 'f': return -15;
+    case 'p': return -12;
+    case 'n': return  -9;
+    case 'u': return  -6;
+    case 'm': return  -3;
+    case 'k': return   3;
+    case 'M': return   6;
+    case 'G': return   9;
+    case 'T': return  12;
+    default:  return   0;
+  }
+}
+
+
+double
+BF_(Value_parse) (const HChar* str, const HChar** endptr)
+{
+  const HChar* p        = str;
+  Bool         negative = False;
+  Bool         digits   = False;
+  ULong        mantissa = 0;
+  Int          exponent = 0;
+  double       x;
+
+
+  if (*p == '-' || *p == '+') negative = (*p++ == '-');
+
+  // Accumulate up to 18 significant digits exactly in mantissa, so
+  // that only the final scaling by 10^exponent rounds
+  for (; VG_(isdigit)(*p); ++p, digits = True)
+  {
+    if (mantissa < 100000000000000000ULL)
+      mantissa = 10 * mantissa + (*p - '0');
+    else
+      exponent++;
+  }
+
+  if (*p == '.')
+  {
+    for (++p; VG_(isdigit)(*p); ++p, digits = True)
+    {
+      if (mantissa < 100000000000000000ULL)
+      {
+        mantissa = 10 * mantissa + (*p - '0');
+        exponent--;
+      }
+    }
+  }
+
+  if (!digits)
+  {
+    if (endptr != 0) *endptr = str;
+    return 0;
+  }
+
+  if (*p == 'e' || *p == 'E')
+  {
+    const HChar* q    = p + 1;
+    Bool         eneg = False;
+    Int          e    = 0;
+
+    if (*q == '-' || *q == '+') eneg = (*q++ == '-');
+
+    if (VG_(isdigit)(*q))
+    {
+      for (; VG_(isdigit)(*q); ++q) if (e < 10000) e = 10 * e + (*q - '0');
+
+      exponent += eneg ? -e : e;
+      p         = q;
+    }
+  }
+
+  if (BF_(siExponent)(*p) != 0)
+  {
+    exponent += BF_(siExponent)(*p++);
+  }
+
+  x = (mantissa == 0) ? 0.0 : BF_(scale10)((double) mantissa, exponent);
+
+  if (endptr != 0) *endptr = p;
+
+  return negative ? -x : x;
+}
@@ -0,0 +1,78 @@
+/**
+ * \file    bf_value.h
+ * \brief   Valgrind Tool: BITFLIPS element value decoding and printing
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+
+#ifndef __BITFLIPS_VALUE_H
+#define __BITFLIPS_VALUE_H
+
+
+#include "bf_include.h"
+
+
+/**
+ * The numeric effect of one SEU on an element: its value before and
+ * after the flip, flipped - original and |delta / original|.  The
+ * relative error is zero when delta is zero and infinite when only
+ * original is.
+ */
+typedef struct
+{
+  double  original;
+  double  flipped;
+  double  delta;
+  double  relerr;
+} VgBF_FlipValue_t;
+
+
+/**
+ * Characters needed by BF_(Value_format)() for any double.
+ */
+#define BF_VALUE_FORMAT_SIZE 32
+
+
+/**
+ * @return the value of an element of the given type whose bits occupy
+ * the low-order bits of bits.
+ */
+double BF_(Value_decode) (VgBF_MemType_t type, ULong bits);
+
+/**
+ * Fills value with the effect of changing an element of the given type
+ * from original to flipped (both as raw bits).
+ */
+void BF_(Value_flip) (  VgBF_FlipValue_t* value
+                      , VgBF_MemType_t    type
+                      , ULong             original
+                      , ULong             flipped );
+
+/**
+ * @return True if x is neither infinite nor NaN.
+ */
+Bool BF_(Value_isFinite) (double x);
+
+/**
+ * Writes x to buf like printf's "%.<precision>e" (precision <= 16),
+ * "inf" or "nan", since VG_(printf) has no exponent format.  The last
+ * digit may be one unit off the correctly rounded value; the raw bits
+ * are exact.  buf must hold BF_VALUE_FORMAT_SIZE characters.
+ *
+ * @return the number of characters written, excluding the NUL.
+ */
+UInt BF_(Value_format) (HChar* buf, double x, UInt precision);
+
+/**
+ * @return the number at str, like VG_(strtod) but also accepting an
+ * exponent ("1.5e-9") and a trailing SI prefix a, f, p, n, u, m, k, M,
+ * G or T ("1.5n").  *endptr, if endptr is not null, is set to the first
+ * character after the number, or to str if there is none.
+ */
+double BF_(Value_parse) (const HChar* str, const HChar** endptr);
+
+
+#endif  /* __BITFLIPS_VALUE_H */
@@ -25,6 +25,9 @@
  *
  * The macros VALGRIND_BITFLIPS_ON() and VALGRIND_BITFLIPS_OFF()
  * control whether or not the fault injection mechanism is enabled.
+ *
+ * VALGRIND_BITFLIPS_MEM_ON() returns non-zero if the block was not
+ * registered because it is empty or overlaps a registered block.
  */
 
 typedef enum
@@ -55,9 +58,29 @@ typedef enum
   , VG_USERREQ__BITFLIPS_OFF
   , VG_USERREQ__BITFLIPS_MEM_ON
   , VG_USERREQ__BITFLIPS_MEM_OFF
+  , VG_USERREQ__BITFLIPS_MEM_ON_BATCH
+  , VG_USERREQ__BITFLIPS_MEM_OFF_BATCH
 } VgBF_ClientRequest_t;
 
 
+/**
+ * Describes one block of memory for VALGRIND_BITFLIPS_MEM_ON_BATCH()
+ * and VALGRIND_BITFLIPS_MEM_OFF_BATCH().  The fields mirror the
+ * arguments of VALGRIND_BITFLIPS_MEM_ON(); name plays the part of its
+ * stringified address and may be null (0).  Only addr and name are used
+ * by VALGRIND_BITFLIPS_MEM_OFF_BATCH().
+ */
+typedef struct
+{
+  void*            addr;
+  unsigned long    rows;
+  unsigned long    cols;
+  VgBF_MemType_t   type;
+  VgBF_MemOrder_t  layout;
+  const char*      name;
+} VgBF_MemDesc_t;
+
+
 #define VALGRIND_BITFLIPS_ON()                \
   (__extension__({unsigned int _qzz_res;      \
    VALGRIND_DO_CLIENT_REQUEST(_qzz_res, 0, VG_USERREQ__BITFLIPS_ON, \
@@ -90,4 +113,27 @@ typedef enum
    }))
 
 
+/**
+ * Registers (or unregisters) the n blocks described by the
+ * VgBF_MemDesc_t array descs with a single client request, which is
+ * much cheaper than n VALGRIND_BITFLIPS_MEM_ON() (or _OFF()) requests.
+ * VALGRIND_BITFLIPS_MEM_ON_BATCH() returns the number of blocks that
+ * were not registered.
+ */
+#define VALGRIND_BITFLIPS_MEM_ON_BATCH(descs, n)                              \
+  (__extension__({unsigned int _qzz_res;                                      \
+   VALGRIND_DO_CLIENT_REQUEST(_qzz_res, 0, VG_USERREQ__BITFLIPS_MEM_ON_BATCH,  \
+                              descs, n, 0, 0, 0);                             \
+     _qzz_res;                                                                \
+   }))
+
+
+#define VALGRIND_BITFLIPS_MEM_OFF_BATCH(descs, n)                             \
+  (__extension__({unsigned int _qzz_res;                                      \
+   VALGRIND_DO_CLIENT_REQUEST(_qzz_res, 0, VG_USERREQ__BITFLIPS_MEM_OFF_BATCH, \
+                              descs, n, 0, 0, 0);                             \
+     _qzz_res;                                                                \
+   }))
+
+
 #endif  /* __BITFLIPS_H */
@@ -0,0 +1,53 @@
+/**
+ * \file    expose_shadow.c
+ * \brief   Regression test: heap and global blocks released in favour of
+ *          a VALGRIND_BITFLIPS_MEM_ON region are exposed again after it
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../bitflips.h"
+
+
+#define ON(addr, rows, type) \
+  VALGRIND_BITFLIPS_MEM_ON(addr, rows, 1, type, BITFLIPS_ROW_MAJOR)
+
+
+double shadow_table[8];
+
+
+int
+main (void)
+{
+  int* p = malloc(16 * sizeof(int));
+  int* q = malloc(16 * sizeof(int));
+
+
+  // The heap block comes back only once neither region overlaps it
+  printf("p + 4       : %u\n", ON(p + 4, 4, BITFLIPS_INT));
+  printf("p + 8       : %u\n", ON(p + 8, 4, BITFLIPS_INT));
+  VALGRIND_BITFLIPS_MEM_OFF(p + 4);
+  VALGRIND_BITFLIPS_MEM_OFF(p + 8);
+
+  // A rejected region releases nothing
+  printf("p + 4       : %u\n", ON(p + 4, 4, BITFLIPS_INT));
+  printf("p           : %u\n", ON(p, 16, BITFLIPS_INT));
+  VALGRIND_BITFLIPS_MEM_OFF(p + 4);
+
+  // A block freed while released is forgotten
+  printf("q           : %u\n", ON(q, 16, BITFLIPS_INT));
+  free(q);
+  VALGRIND_BITFLIPS_MEM_OFF(q);
+
+  printf("shadow_table: %u\n", ON(shadow_table + 2, 2, BITFLIPS_DOUBLE));
+  VALGRIND_BITFLIPS_MEM_OFF(shadow_table + 2);
+
+  free(p);
+
+  return 0;
+}
@@ -0,0 +1,47 @@
+/**
+ * \file    flip_masks.c
+ * \brief   Regression test program: exposes a small block (two bytes, or
+ *          with "word", one double) and runs long enough at a high fault
+ *          rate for every SEU shape to occur
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+#include <string.h>
+
+#include "../bitflips.h"
+
+
+/* Enough loop iterations for several hundred SEUs at --fault-rate=0.1 */
+#define SPINS 500000
+
+
+static unsigned char cells[2];
+static double        word;
+
+
+int
+main (int argc, char* argv[])
+{
+  int                    wide = argc > 1 && strcmp(argv[1], "word") == 0;
+  volatile unsigned long i;
+
+
+  if (wide)
+  {
+    VALGRIND_BITFLIPS_MEM_ON(&word, 1, 1, BITFLIPS_DOUBLE, BITFLIPS_ROW_MAJOR);
+  }
+  else
+  {
+    VALGRIND_BITFLIPS_MEM_ON(cells, 2, 1, BITFLIPS_UCHAR, BITFLIPS_ROW_MAJOR);
+  }
+
+  for (i = 0; i < SPINS; ++i) { }
+
+  if (wide) VALGRIND_BITFLIPS_MEM_OFF(&word);
+  else      VALGRIND_BITFLIPS_MEM_OFF(cells);
+
+  return 0;
+}
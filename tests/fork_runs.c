@@ -0,0 +1,39 @@
+/**
+ * \file    fork_runs.c
+ * \brief   Regression test: --fork-runs repeats the program's suffix after
+ *          VALGRIND_BITFLIPS_ON and reports each run's exit status
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+#include <stdio.h>
+
+#include "../bitflips.h"
+
+
+static double grid[16];
+
+
+int
+main (void)
+{
+  double sum = 0;
+  int    i;
+
+
+  // The fault-free prefix: nothing is printed here, or every run would
+  // inherit it in its stdio buffer
+  for (i = 0; i < 16; ++i) grid[i] = i;
+
+  VALGRIND_BITFLIPS_MEM_ON(grid, 16, 1, BITFLIPS_DOUBLE, BITFLIPS_ROW_MAJOR);
+  VALGRIND_BITFLIPS_ON();
+
+  for (i = 0; i < 16; ++i) sum += grid[i];
+
+  printf("sum: %g\n", sum);
+
+  // Every run fails, so the parent reports each one
+  return 3;
+}
@@ -0,0 +1,59 @@
+/**
+ * \file    inject_fn.c
+ * \brief   Regression test: --inject-in-fn confines SEUs to the
+ *          instructions of the selected functions
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+#include <stdio.h>
+
+#include "../bitflips.h"
+
+
+/* At --fault-rate=0.1, thousands of SEUs in either loop if selected */
+#define SPINS 500000
+
+#define NOINLINE __attribute__((noinline))
+
+
+static unsigned long word = 42;
+
+
+NOINLINE void
+cold (void)
+{
+  volatile unsigned long i;
+
+
+  for (i = 0; i < SPINS; ++i) { }
+}
+
+
+NOINLINE void
+hot (void)
+{
+  volatile unsigned long i;
+
+
+  for (i = 0; i < SPINS; ++i) { }
+}
+
+
+int
+main (void)
+{
+  VALGRIND_BITFLIPS_MEM_ON(&word, 1, 1, BITFLIPS_ULONG, BITFLIPS_ROW_MAJOR);
+
+  cold();
+  printf("cold: %s\n", (word == 42) ? "intact" : "changed");
+
+  hot();
+  printf("hot : %s\n", (word == 42) ? "intact" : "changed");
+
+  VALGRIND_BITFLIPS_MEM_OFF(&word);
+
+  return 0;
+}
@@ -0,0 +1,53 @@
+/**
+ * \file    lazy_mask.c
+ * \brief   Regression test: under --inject-mode=lazy, a store over every
+ *          flipped bit masks pending SEUs and a load activates them
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+#include <stdio.h>
+
+#include "../bitflips.h"
+
+
+/* At --fault-rate=0.1, thousands of SEUs pend on word during a spin */
+#define SPINS 500000
+
+
+static unsigned long word = 42;
+
+
+static void
+spin (void)
+{
+  volatile unsigned long i;
+
+
+  for (i = 0; i < SPINS; ++i) { }
+}
+
+
+int
+main (void)
+{
+  VALGRIND_BITFLIPS_MEM_ON(&word, 1, 1, BITFLIPS_ULONG, BITFLIPS_ROW_MAJOR);
+
+  // Injection is off while word is accessed, so no SEU arrives between
+  // the store and the load that checks it
+  spin();
+  VALGRIND_BITFLIPS_OFF();
+  word = 7;
+  printf("masked   : %lu\n", word);
+
+  VALGRIND_BITFLIPS_ON();
+  spin();
+  VALGRIND_BITFLIPS_OFF();
+  printf("activated: %s\n", (word == 7) ? "intact" : "changed");
+
+  VALGRIND_BITFLIPS_MEM_OFF(&word);
+
+  return 0;
+}
@@ -0,0 +1,57 @@
+/**
+ * \file    memon_overlap.c
+ * \brief   Regression test: VALGRIND_BITFLIPS_MEM_ON rejects empty blocks
+ *          and blocks overlapping a registered one
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+#include <stdio.h>
+
+#include "../bitflips.h"
+
+
+#define ON(addr, rows, cols, type) \
+  VALGRIND_BITFLIPS_MEM_ON(addr, rows, cols, type, BITFLIPS_ROW_MAJOR)
+
+
+static double grid[16];
+static int    flags[8];
+
+
+int
+main (void)
+{
+  VgBF_MemDesc_t descs[3] =
+  {
+      { &flags[0], 4, 1, BITFLIPS_INT, BITFLIPS_ROW_MAJOR, "flags low"  }
+    , { &flags[2], 4, 1, BITFLIPS_INT, BITFLIPS_ROW_MAJOR, "flags mid"  }
+    , { &flags[4], 4, 1, BITFLIPS_INT, BITFLIPS_ROW_MAJOR, "flags high" }
+  };
+
+
+  printf("grid      : %u\n", ON(grid, 8, 1, BITFLIPS_DOUBLE));
+
+  // Same start, overlapping the tail, and wholly inside: all rejected
+  printf("grid again: %u\n", ON(grid, 8, 1, BITFLIPS_DOUBLE));
+  printf("grid + 4  : %u\n", ON(grid + 4, 8, 1, BITFLIPS_DOUBLE));
+  printf("grid + 2  : %u\n", ON(grid + 2, 2, 1, BITFLIPS_DOUBLE));
+
+  // Adjacent, and empty
+  printf("grid + 8  : %u\n", ON(grid + 8, 8, 1, BITFLIPS_DOUBLE));
+  printf("flags     : %u\n", ON(flags, 0, 8, BITFLIPS_INT));
+
+  // Once deregistered, the range may be registered again, with a new shape
+  VALGRIND_BITFLIPS_MEM_OFF(grid);
+  printf("grid + 4  : %u\n",
+         VALGRIND_BITFLIPS_MEM_ON(grid + 4, 2, 2, BITFLIPS_DOUBLE,
+                                  BITFLIPS_COL_MAJOR));
+
+  // A batch reports how many of its blocks were rejected: the middle one
+  // overlaps the first
+  printf("batch     : %u\n", VALGRIND_BITFLIPS_MEM_ON_BATCH(descs, 3));
+
+  return 0;
+}
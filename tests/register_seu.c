@@ -0,0 +1,52 @@
+/**
+ * \file    register_seu.c
+ * \brief   Regression test: --register-fault-rate flips guest registers
+ *          and counts them apart from memory SEUs
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+/* About a hundred register SEUs at --register-fault-rate=2e-8 */
+#define SPINS 500000
+
+#define NOINLINE __attribute__((noinline))
+
+
+#if defined(__x86_64__)
+
+static volatile unsigned long spins = SPINS;
+
+
+/*
+ * Run with --inject-in-fn=spin, so that only these instructions see
+ * register SEUs.  None can derail them: the loop counts down in memory
+ * without using a general-purpose register, and the exit is retried
+ * until it succeeds.
+ */
+NOINLINE void
+spin (void)
+{
+  __asm__ __volatile__(
+    "1: decq %0\n\t"
+    "   jnz  1b\n\t"
+    "2: movl $231, %%eax\n\t"    /* exit_group(0) */
+    "   xorl %%edi, %%edi\n\t"
+    "   syscall\n\t"
+    "   jmp  2b\n\t"
+    : "+m" (spins) : : "rax", "rdi", "rcx", "r11", "memory" );
+}
+
+#endif
+
+
+int
+main (void)
+{
+#if defined(__x86_64__)
+  spin();
+#endif
+
+  return 0;
+}
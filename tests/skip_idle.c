@@ -0,0 +1,46 @@
+/**
+ * \file    skip_idle.c
+ * \brief   Regression test: --skip-idle leaves the idle state when an SEU
+ *          becomes possible and returns to it only at VALGRIND_BITFLIPS_OFF
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+#include "../bitflips.h"
+
+
+#define ON(addr) \
+  VALGRIND_BITFLIPS_MEM_ON(addr, 16, 1, BITFLIPS_DOUBLE, BITFLIPS_ROW_MAJOR)
+
+
+static double grid[16];
+
+
+int
+main (void)
+{
+  int i;
+
+
+  // Injection is on but nothing is exposed until the first MEM_ON; the
+  // exposure dropping back to zero does not make the tool idle again
+  for (i = 0; i < 3; ++i)
+  {
+    ON(grid);
+    VALGRIND_BITFLIPS_MEM_OFF(grid);
+  }
+
+  VALGRIND_BITFLIPS_OFF();
+
+  // While injection is off, exposure changes nothing
+  ON(grid);
+  VALGRIND_BITFLIPS_MEM_OFF(grid);
+
+  VALGRIND_BITFLIPS_ON();
+  ON(grid);
+  VALGRIND_BITFLIPS_MEM_OFF(grid);
+
+  return 0;
+}
@@ -0,0 +1,55 @@
+/**
+ * \file    stack_switch.c
+ * \brief   Regression test: --expose-stack ignores a stack pointer on a
+ *          coroutine stack outside the thread's stack
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <ucontext.h>
+
+
+/*
+ * The coroutine's stack is in .bss, far below the thread's stack.  Run
+ * with a --max-stackframe larger than the distance between them, so
+ * that Valgrind reports the switch as stack growth.  Were it taken as
+ * such, the stack block would span terabytes and a fault rate at which
+ * the real stack sees no SEU would flip bits all over the address
+ * space.
+ */
+static char       coStack[64 * 1024];
+static ucontext_t mainContext;
+static ucontext_t coContext;
+
+
+static void
+coroutine (void)
+{
+  char frame[256];
+
+
+  memset(frame, 1, sizeof(frame));
+  printf("coroutine: %d\n", frame[sizeof(frame) - 1]);
+}
+
+
+int
+main (void)
+{
+  getcontext(&coContext);
+
+  coContext.uc_stack.ss_sp   = coStack;
+  coContext.uc_stack.ss_size = sizeof(coStack);
+  coContext.uc_link          = &mainContext;
+
+  makecontext(&coContext, coroutine, 0);
+  swapcontext(&mainContext, &coContext);
+
+  printf("main     : back\n");
+
+  return 0;
+}
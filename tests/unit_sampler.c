@@ -0,0 +1,200 @@
+/**
+ * \file    unit_sampler.c
+ * \brief   Unit test: BITFLIPS Poisson and skip-ahead sampler statistics
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+#include <stdio.h>
+
+#include "pub_tool_basics.h"
+#include "pub_tool_libcbase.h"
+
+
+/*
+ * The modules are compiled into this program, as memcheck's unit_oset
+ * does with m_oset.c.  VG_(random) is the LCG of m_libcbase.c.
+ */
+UInt
+VG_(random) (UInt* pSeed)
+{
+  static UInt seed = 0;
+
+
+  if (pSeed == NULL) pSeed = &seed;
+
+  *pSeed = 1103515245 * *pSeed + 12345;
+
+  return *pSeed;
+}
+
+
+#include "../bf_math.c"
+#include "../bf_poisson.c"
+#include "../bf_random.c"
+
+
+#define DRAWS  100000
+
+/* Tolerance of every check, in standard errors of the estimate */
+#define SIGMAS 5.0
+
+
+static Int Failures = 0;
+
+
+/**
+ * Reports whether the estimate is within SIGMAS standard errors (error)
+ * of expected.
+ */
+static void
+check (  const HChar* what
+       , double       lambda
+       , double       estimate
+       , double       expected
+       , double       error )
+{
+  Bool ok = fabs(estimate - expected) <= SIGMAS * error;
+
+
+  if (ok)
+  {
+    printf("%-22s lambda=%-7g ok\n", what, lambda);
+  }
+  else
+  {
+    printf("%-22s lambda=%-7g FAILED: %g, expected %g +- %g\n",
+           what, lambda, estimate, expected, SIGMAS * error);
+    Failures++;
+  }
+}
+
+
+/**
+ * Checks the mean and variance of random_poisson_sampler_draw() against
+ * lambda.
+ */
+static void
+testPoisson (double lambda)
+{
+  random_poisson_sampler s;
+  double                 sum  = 0;
+  double                 sum2 = 0;
+  double                 mean;
+  Int                    i;
+  Int                    k;
+
+
+  random_poisson_sampler_init(&s, lambda);
+
+  for (i = 0; i < DRAWS; ++i)
+  {
+    k     = random_poisson_sampler_draw(&s, BF_(Random_uniform));
+    sum  += k;
+    sum2 += (double) k * k;
+  }
+
+  mean = sum / DRAWS;
+
+  check("poisson mean", lambda, mean, lambda, sqrt(lambda / DRAWS));
+  check("poisson variance", lambda, sum2 / DRAWS - mean * mean, lambda,
+        sqrt((lambda + 2 * lambda * lambda) / DRAWS));
+}
+
+
+/**
+ * Checks the mean of random_poisson_sampler_draw_positive() against
+ * that of a zero-truncated Poisson(lambda) variate, and that it never
+ * returns zero.
+ */
+static void
+testPositive (double lambda)
+{
+  random_poisson_sampler s;
+  double                 mean  = lambda / (1 - exp(-lambda));
+  double                 sum   = 0;
+  Int                    zeros = 0;
+  Int                    i;
+  Int                    k;
+
+
+  random_poisson_sampler_init(&s, lambda);
+
+  for (i = 0; i < DRAWS; ++i)
+  {
+    k    = random_poisson_sampler_draw_positive(&s, BF_(Random_uniform));
+    sum += k;
+    if (k == 0) zeros++;
+  }
+
+  check("positive mean", lambda, sum / DRAWS, mean,
+        sqrt(mean * (1 + lambda - mean) / DRAWS));
+  check("positive zeros", lambda, zeros, 0, 0);
+}
+
+
+/**
+ * Checks random_poisson_gap(), the skip-ahead schedule's draw, against
+ * a geometric variate with success probability 1 - exp(-lambda): its
+ * mean and the fraction of gaps of one (a fault on the very next
+ * instruction).
+ */
+static void
+testGap (double lambda)
+{
+  double p    = 1 - exp(-lambda);
+  double sum  = 0;
+  Int    ones = 0;
+  Int    i;
+  ULong  gap;
+
+
+  for (i = 0; i < DRAWS; ++i)
+  {
+    gap  = random_poisson_gap(lambda, BF_(Random_uniform));
+    sum += (double) gap;
+    if (gap == 1) ones++;
+  }
+
+  check("gap mean", lambda, sum / DRAWS, 1 / p,
+        sqrt((1 - p) / (p * p) / DRAWS));
+  check("gap of one", lambda, (double) ones / DRAWS, p,
+        sqrt(p * (1 - p) / DRAWS));
+}
+
+
+int
+main (void)
+{
+  static const double lambdas[] = { 0.001, 0.5, 3, 9.5, 10, 40, 1000 };
+  static const double gaps[]    = { 0.0001, 0.01, 0.5, 3 };
+  VgBF_RngKind_t      kind;
+  UInt                i;
+
+
+  for (kind = BF_RNG_LCG; kind <= BF_RNG_XOSHIRO; ++kind)
+  {
+    printf("-- %s\n", (kind == BF_RNG_LCG) ? "lcg" : "xoshiro");
+
+    BF_(Random_seed)(kind, 42);
+
+    for (i = 0; i < sizeof(lambdas) / sizeof(lambdas[0]); ++i)
+    {
+      testPoisson(lambdas[i]);
+      testPositive(lambdas[i]);
+    }
+
+    for (i = 0; i < sizeof(gaps) / sizeof(gaps[0]); ++i)
+    {
+      testGap(gaps[i]);
+    }
+  }
+
+  printf("gap of zero rate      %s\n",
+         (random_poisson_gap(0, BF_(Random_uniform)) == ~0ULL) ?
+         "ok" : "FAILED");
+
+  return Failures != 0;
+}
@@ -0,0 +1,243 @@
+/**
+ * \file    unit_trace.c
+ * \brief   Unit test: BITFLIPS binary fault trace records and layout
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pub_tool_basics.h"
+#include "pub_tool_libcassert.h"
+#include "pub_tool_libcbase.h"
+#include "pub_tool_libcfile.h"
+#include "pub_tool_libcprint.h"
+#include "pub_tool_mallocfree.h"
+
+
+/*
+ * The module is compiled into this program, as memcheck's unit_oset does
+ * with m_oset.c, with the Valgrind functions it calls redirected to their
+ * libc equivalents.
+ */
+SysRes
+VG_(open) (const HChar* pathname, Int flags, Int mode)
+{
+  Int    fd  = open(pathname, flags, mode);
+  SysRes res = { ._isError = (fd < 0), ._val = (fd < 0) ? 0 : fd };
+
+
+  return res;
+}
+
+
+Int   VG_(write)  (Int fd, const void* buf, Int count)
+                  { return write(fd, buf, count); }
+void  VG_(close)  (Int fd) { close(fd); }
+void* VG_(malloc) (const HChar* cc, SizeT nbytes) { return malloc(nbytes); }
+void  VG_(free)   (void* p) { free(p); }
+void* VG_(memcpy) (void* d, const void* s, SizeT sz)
+                  { return memcpy(d, s, sz); }
+void* VG_(memset) (void* s, Int c, SizeT sz) { return memset(s, c, sz); }
+HChar* VG_(strcpy) (HChar* dest, const HChar* src)
+                   { return strcpy(dest, src); }
+SizeT VG_(strlen) (const HChar* str) { return strlen(str); }
+Bool  VG_(isdigit) (HChar c) { return c >= '0' && c <= '9'; }
+
+
+UInt
+VG_(sprintf) (HChar* buf, const HChar* format, ...)
+{
+  va_list args;
+  Int     n;
+
+
+  va_start(args, format);
+  n = vsprintf(buf, format, args);
+  va_end(args);
+
+  return n;
+}
+
+
+UInt
+VG_(message) (VgMsgKind kind, const HChar* format, ...)
+{
+  printf("message: %s", format);
+  return 0;
+}
+
+
+void
+VG_(assert_fail) (  Bool         isCore
+                  , const HChar* expr
+                  , const HChar* file
+                  , Int          line
+                  , const HChar* fn
+                  , const HChar* format
+                  , ... )
+{
+  printf("%s:%d: %s: assertion '%s' failed\n", file, line, fn, expr);
+  exit(1);
+}
+
+
+// bf_math.h has its own byte order test, which <fcntl.h> would upset
+#undef __LITTLE_ENDIAN
+
+#include "../bf_math.c"
+#include "../bf_value.c"
+#include "../bf_trace.c"
+
+
+#define TRACE_FILE "unit_trace.trace"
+
+
+static VgBF_MemBlock_t Grid;
+static VgBF_MemBlock_t Flags;
+
+
+static void
+fault (  VgBF_MemBlock_t* block
+       , ULong            instruction
+       , UInt             row
+       , UInt             col
+       , ULong            original
+       , ULong            mask )
+{
+  VgBF_FlipValue_t value;
+
+
+  BF_(Value_flip)(&value, block->type, original, original ^ mask);
+  BF_(Trace_fault)(block, instruction, row, col, original, mask,
+                   original ^ mask, &value);
+}
+
+
+/**
+ * Writes a trace of three SEUs in two blocks, as the tool would.
+ */
+static void
+writeTrace (void)
+{
+  Grid.start     = 0x5000;
+  Grid.num_rows  = 4;
+  Grid.num_cols  = 4;
+  Grid.desc      = "grid";
+  Grid.type      = BITFLIPS_DOUBLE;
+  Grid.layout    = BITFLIPS_ROW_MAJOR;
+  Grid.id        = 0;
+
+  Flags.start    = 0x6000;
+  Flags.num_rows = 8;
+  Flags.num_cols = 1;
+  Flags.desc     = "flags, 2nd set";
+  Flags.type     = BITFLIPS_INT;
+  Flags.layout   = BITFLIPS_COL_MAJOR;
+  Flags.id       = 1;
+
+  if ( !BF_(Trace_open)(TRACE_FILE, 42, 1.5e-9) )
+  {
+    printf("cannot create %s\n", TRACE_FILE);
+    exit(1);
+  }
+
+  // 1.5 with the lowest exponent bit cleared is 0.75
+  fault(&Grid ,  1000, 1, 2, 0x3ff8000000000000ULL, 1ULL << 52);
+  fault(&Flags,  2500, 3, 0, 7                    , 1ULL << 31);
+  fault(&Grid ,  4000, 3, 3, 0                    , 1ULL << 62);
+
+  BF_(Trace_close)(3, 5000, 0.128);
+}
+
+
+/**
+ * Prints every record of the trace, with its offset and size.
+ */
+static void
+dumpTrace (void)
+{
+  static UChar        raw[4096];
+  FILE*               stream = fopen(TRACE_FILE, "rb");
+  SizeT               size   = fread(raw, 1, sizeof(raw), stream);
+  SizeT               pos;
+  VgBF_TraceHeader_t* header = (VgBF_TraceHeader_t*) raw;
+
+
+  fclose(stream);
+
+  printf("header @0   %2u: %s version %u, endian %s, seed %u, rate %g\n",
+         header->header_size, header->magic, header->version,
+         (header->endian == BF_TRACE_ENDIAN) ? "native" : "foreign",
+         header->seed, header->fault_rate);
+
+  for (pos = header->header_size; pos < size; )
+  {
+    VgBF_TraceRecord_t* record = (VgBF_TraceRecord_t*) (raw + pos);
+
+    if (record->kind == BF_TRACE_BLOCK)
+    {
+      VgBF_TraceBlock_t* r = (VgBF_TraceBlock_t*) record;
+
+      printf("block  @%-3lu %2u: id %u, type %u, layout %u, start %#llx, "
+             "%llux%llu, \"%s\" (%u)\n",
+             (unsigned long) pos, record->size, r->id, r->type, r->layout,
+             r->start, r->rows, r->cols, (const HChar*) (r + 1),
+             r->name_len);
+    }
+    else if (record->kind == BF_TRACE_FAULT)
+    {
+      VgBF_TraceFault_t* r = (VgBF_TraceFault_t*) record;
+
+      printf("fault  @%-3lu %2u: insn %llu, block %u, type %u, (%u, %u), "
+             "%#llx ^ %#llx = %#llx\n"
+             "              %g -> %g, delta %g, relerr %g\n",
+             (unsigned long) pos, record->size, r->instruction, r->block,
+             r->type, r->row, r->col, r->original, r->mask, r->flipped,
+             r->original_value, r->flipped_value, r->delta, r->relerr);
+    }
+    else if (record->kind == BF_TRACE_END)
+    {
+      VgBF_TraceEnd_t* r = (VgBF_TraceEnd_t*) record;
+
+      printf("end    @%-3lu %2u: faults %llu, instructions %llu, "
+             "flux %g\n",
+             (unsigned long) pos, record->size, r->faults, r->instructions,
+             r->kilobyte_flux);
+    }
+    else
+    {
+      printf("kind %u @%lu %u\n", record->kind, (unsigned long) pos,
+             record->size);
+    }
+
+    if (record->size == 0 || record->size % 8 != 0) break;
+
+    pos += record->size;
+  }
+
+  printf("total  %lu bytes\n", (unsigned long) size);
+}
+
+
+int
+main (void)
+{
+  writeTrace();
+  dumpTrace();
+
+  // Blocks are described once per trace
+  printf("traced %s, %s\n", Grid.traced  ? "yes" : "no",
+                            Flags.traced ? "yes" : "no");
+
+  unlink(TRACE_FILE);
+
+  return 0;
+}
@@ -0,0 +1,110 @@
+/**
+ * \file    unit_value.c
+ * \brief   Unit test: BITFLIPS number parsing and exponent formatting
+ * \author  Ben Bornstein
+ */
+/* Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+ * U.S. Government Sponsorship acknowledged.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "pub_tool_basics.h"
+#include "pub_tool_libcbase.h"
+#include "pub_tool_libcprint.h"
+
+
+/*
+ * The module is compiled into this program, as memcheck's unit_oset does
+ * with m_oset.c, with the few Valgrind functions it calls redirected to
+ * their libc equivalents.
+ */
+Bool
+VG_(isdigit) (HChar c)
+{
+  return c >= '0' && c <= '9';
+}
+
+
+UInt
+VG_(sprintf) (HChar* buf, const HChar* format, ...)
+{
+  va_list args;
+  Int     n;
+
+
+  va_start(args, format);
+  n = vsprintf(buf, format, args);
+  va_end(args);
+
+  return n;
+}
+
+
+#include "../bf_math.c"
+#include "../bf_value.c"
+
+
+static void
+parse (const HChar* str)
+{
+  const HChar* end;
+  double       x = BF_(Value_parse)(str, &end);
+
+
+  printf("parse  %-24s -> %.15g, rest \"%s\"\n", str, x, end);
+}
+
+
+static void
+format (const HChar* expr, double x, UInt precision)
+{
+  HChar buf[BF_VALUE_FORMAT_SIZE];
+  UInt  n = BF_(Value_format)(buf, x, precision);
+
+
+  printf("format %-24s %2u -> %s (%u)\n", expr, precision, buf, n);
+}
+
+#define FORMAT(x, precision)  format(#x, x, precision)
+
+
+int
+main (void)
+{
+  parse("0");
+  parse("42");
+  parse("-3.25");
+  parse("+.5");
+  parse("1.5e-9");
+  parse("1.5E+9");
+  parse("1.5n");
+  parse("2k");
+  parse("5M/s");
+  parse("1e3x");
+  parse("7e");
+  parse("7e-");
+  parse("e5");
+  parse("-");
+  parse("12345678901234567890");
+  parse("0.000123456789012345678");
+
+  FORMAT(0.0        ,  4);
+  FORMAT(-0.0       ,  2);
+  FORMAT(1.0        ,  0);
+  FORMAT(1.5e-9     ,  4);
+  FORMAT(-2.5e-300  ,  3);
+  FORMAT(123456.789 ,  3);
+  FORMAT(9.9999     ,  2);
+  FORMAT(0.099999   ,  3);
+  FORMAT(1e300      ,  6);
+  FORMAT(5e-324     ,  3);
+  FORMAT(1.0 / 3    , 16);
+  FORMAT(1.0 / 3    , 20);
+  FORMAT(1.0 / 0.0  ,  4);
+  FORMAT(-1.0 / 0.0 ,  4);
+  FORMAT(0.0 / 0.0  ,  4);
+
+  return 0;
+}
@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+
+##
+## Filename    : wrapper_trace.py
+## Description : Regression test of the bitflips wrapper's trace reader
+## Author(s)   : Ben Bornstein
+##
+## Copyright 2007 California Institute of Technology.  ALL RIGHTS RESERVED.
+## U.S. Government Sponsorship acknowledged.
+##
+## trace_v2.bin is the trace unit_trace.c writes through the tool's own
+## bf_trace.c: a 4x4 double block "grid" and an int block "flags, 2nd
+## set", three SEUs and the END record.  Big-endian, version 1 and
+## truncated traces are derived from it here.
+##
+
+
+import csv
+import importlib.machinery
+import importlib.util
+import io
+import os
+import struct
+import tempfile
+import unittest
+
+
+HERE    = os.path.dirname(os.path.abspath(__file__))
+FIXTURE = os.path.join(HERE, "trace_v2.bin")
+
+
+def load_wrapper ():
+  """Imports ../bitflips.in, which has no .py suffix, as a module."""
+  path   = os.path.join(HERE, "..", "bitflips.in")
+  loader = importlib.machinery.SourceFileLoader("bitflips", path)
+  spec   = importlib.util.spec_from_loader("bitflips", loader)
+  module = importlib.util.module_from_spec(spec)
+  loader.exec_module(module)
+  return module
+
+
+bitflips = load_wrapper()
+
+
+class Rows (list):
+  """A convert_trace() writer that keeps the rows."""
+
+  def write (self, row):
+    self.append(row)
+
+  def close (self):
+    pass
+
+
+def reencode (raw, order, version):
+  """Rewrites the little-endian version 2 trace raw in the given byte
+  order and trace version.
+  """
+  (old, size, endian, seed, rate) = struct.unpack_from("<IIIId", raw, 8)
+  out = raw[:8] + struct.pack(order + "IIIId", version, size, endian, seed,
+                              rate)
+  pos = size
+
+  while pos < len(raw):
+    (kind, size) = struct.unpack_from("<II", raw, pos)
+    body         = raw[pos + 8:pos + size]
+
+    if kind == bitflips.TRACE_BLOCK:
+      fields = struct.unpack_from("<IIIIQQQ", body)
+      body   = struct.pack(order + "IIIIQQQ", *fields) + body[40:]
+    elif kind == bitflips.TRACE_FAULT:
+      fields = struct.unpack_from("<QIIIIQQQdddd", body)
+      if version < 2:
+        body = struct.pack(order + "QIIIIQQQ", *fields[:8])
+      else:
+        body = struct.pack(order + "QIIIIQQQdddd", *fields)
+    elif kind == bitflips.TRACE_END:
+      body = struct.pack(order + "QQd", *struct.unpack_from("<QQd", body))
+
+    out += struct.pack(order + "II", kind, len(body) + 8) + body
+    pos += size
+
+  return out
+
+
+class TraceTest (unittest.TestCase):
+
+  def setUp (self):
+    with open(FIXTURE, "rb") as stream:
+      self.raw = stream.read()
+
+  def convert (self, raw):
+    """Returns (rows, end record) for the trace raw."""
+    rows = Rows()
+
+    with tempfile.NamedTemporaryFile(suffix=".trace") as trace:
+      trace.write(raw)
+      trace.flush()
+      end = bitflips.convert_trace(trace.name, [ rows ])
+
+    return rows, end
+
+  def check_rows (self, rows, decoded=True):
+    self.assertEqual(len(rows), 3)
+    self.assertEqual(rows[0][:8], (1000, "grid", "double", 1, 2,
+                                   0x3ff8000000000000, 1 << 52,
+                                   0x3fe8000000000000))
+    self.assertEqual(rows[1][:8], (2500, "flags, 2nd set", "int", 3, 0,
+                                   7, 1 << 31, 0x80000007))
+    self.assertEqual(rows[2][:5], (4000, "grid", "double", 3, 3))
+
+    if decoded:
+      self.assertEqual(rows[0][8:], (1.5, 0.75, -0.75, 0.5))
+      self.assertEqual(rows[1][8:10], (7.0, -2147483641.0))
+      self.assertEqual(rows[2][8:11], (0.0, 2.0, 2.0))
+      self.assertEqual(rows[2][11], float("inf"))
+    else:
+      self.assertEqual(rows[0][8:], (None, None, None, None))
+
+  def test_header (self):
+    (header, records) = bitflips.read_trace(io.BytesIO(self.raw))
+
+    self.assertEqual(header, { "version": 2, "seed": 42,
+                               "fault_rate": 1.5e-9 })
+
+    kinds = [ kind for (kind, record) in records ]
+    self.assertEqual(kinds, [ 1, 2, 1, 2, 2, 3 ])
+
+  def test_blocks (self):
+    (header, records) = bitflips.read_trace(io.BytesIO(self.raw))
+    blocks = [ record for (kind, record) in records if kind == 1 ]
+
+    self.assertEqual(blocks[0], { "id": 0, "type": 512, "layout": 1024,
+                                  "name": "grid", "start": 0x5000,
+                                  "rows": 4, "cols": 4 })
+    self.assertEqual(blocks[1]["name"], "flags, 2nd set")
+    self.assertEqual(blocks[1]["layout"], 2048)
+
+  def test_convert (self):
+    (rows, end) = self.convert(self.raw)
+
+    self.check_rows(rows)
+    self.assertEqual(end, { "faults": 3, "instructions": 5000,
+                            "kilobyte_flux": 0.128 })
+
+  def test_big_endian (self):
+    (rows, end) = self.convert( reencode(self.raw, ">", 2) )
+
+    self.check_rows(rows)
+    self.assertEqual(end["faults"], 3)
+
+  def test_version_1 (self):
+    (rows, end) = self.convert( reencode(self.raw, "<", 1) )
+
+    self.check_rows(rows, decoded=False)
+    self.assertEqual(end["instructions"], 5000)
+
+  def test_truncated (self):
+    # Into the END record, then into the last SEU, which is dropped
+    for (cut, seus) in ((1, 3), (32, 3), (40, 2)):
+      (rows, end) = self.convert(self.raw[:-cut])
+
+      self.assertEqual(len(rows), seus)
+      self.assertIsNone(end)
+
+  def test_not_a_trace (self):
+    with self.assertRaises(ValueError):
+      bitflips.read_trace( io.BytesIO(b"BFTRACX\0" + self.raw[8:]) )
+    with self.assertRaises(ValueError):
+      bitflips.read_trace( io.BytesIO(self.raw[:16]) )
+
+  def test_csv (self):
+    with tempfile.TemporaryDirectory() as tempdir:
+      path   = os.path.join(tempdir, "seus.csv")
+      writer = bitflips.CsvWriter(path)
+      end    = bitflips.convert_trace(FIXTURE, [ writer ])
+      writer.close()
+
+      with open(path, newline="") as stream:
+        table = list( csv.reader(stream) )
+
+    self.assertEqual(tuple(table[0]), bitflips.COLUMNS)
+    self.assertEqual(len(table), 4)
+    self.assertEqual(table[2][:5], [ "2500", "flags, 2nd set", "int",
+                                     "3", "0" ])
+    self.assertIsNotNone(end)
+
+
+if __name__ == "__main__":
+  unittest.main()